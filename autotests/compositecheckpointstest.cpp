@@ -0,0 +1,113 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "../src/annotations/compositecheckpoints.h"
+
+#include <QImage>
+#include <QObject>
+#include <QPainter>
+#include <QTest>
+
+class CompositeCheckpointsTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testRestore();
+    void testFind();
+    void testBudget();
+};
+
+using Checkpoint = CompositeCheckpoints::Checkpoint;
+
+static QImage baseImage()
+{
+    QImage image(600, 400, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::white);
+    return image;
+}
+
+void CompositeCheckpointsTest::testRestore()
+{
+    const auto base = baseImage();
+    auto painted = base;
+    const QRect rect{250, 100, 300, 50};
+    QPainter painter(&painted);
+    painter.fillRect(rect, Qt::red);
+    painter.end();
+
+    const Checkpoint checkpoint{1, {base.cacheKey(), {1}}, CompositeCheckpoints::updatedTiles(painted, rect, {})};
+    // Only the tiles in the first row and the second and third columns were painted.
+    QCOMPARE(checkpoint.tiles.size(), qsizetype(2));
+    QVERIFY(!checkpoint.tiles.contains(QPoint{0, 0}));
+    QVERIFY(checkpoint.tiles.contains(QPoint{1, 0}));
+    QVERIFY(checkpoint.tiles.contains(QPoint{2, 0}));
+    // Tiles at the edges are cut to the image.
+    QCOMPARE(checkpoint.tiles.value(QPoint{2, 0}).size(), QSize(600 - 512, 256));
+
+    auto restored = base;
+    CompositeCheckpoints::restore(restored, checkpoint);
+    QCOMPARE(restored, painted);
+
+    // Part of the image, across tiles and at the edge.
+    const QRect part{200, 80, 400, 120};
+    auto restoredPart = base.copy(part);
+    CompositeCheckpoints::restore(restoredPart, checkpoint, part.topLeft());
+    QCOMPARE(restoredPart, painted.copy(part));
+
+    // Unchanged tiles are shared with the earlier checkpoint.
+    const auto tiles = CompositeCheckpoints::updatedTiles(painted, QRect{0, 300, 10, 10}, checkpoint.tiles);
+    QCOMPARE(tiles.size(), qsizetype(3));
+    QCOMPARE(tiles.value(QPoint{1, 0}).cacheKey(), checkpoint.tiles.value(QPoint{1, 0}).cacheKey());
+}
+
+void CompositeCheckpointsTest::testFind()
+{
+    CompositeCheckpoints checkpoints;
+    QVERIFY(!checkpoints.find(10, [](const Checkpoint &) { return true; }));
+    checkpoints.insert({2, {1, {1, 2}}, {}});
+    checkpoints.insert({5, {1, {1, 2, 3}}, {}});
+    checkpoints.insert({8, {1, {1, 2, 3, 4}}, {}});
+
+    auto all = [](const Checkpoint &) {
+        return true;
+    };
+    QCOMPARE(checkpoints.find(10, all)->position, qsizetype(8));
+    QCOMPARE(checkpoints.find(7, all)->position, qsizetype(5));
+    QCOMPARE(checkpoints.find(5, all)->position, qsizetype(5));
+    QVERIFY(!checkpoints.find(1, all));
+
+    // Invalid checkpoints are skipped and dropped.
+    auto withoutThree = [](const Checkpoint &checkpoint) {
+        return !checkpoint.sources.revisions.contains(3);
+    };
+    QCOMPARE(checkpoints.find(10, withoutThree)->position, qsizetype(2));
+    QCOMPARE(checkpoints.find(10, all)->position, qsizetype(2));
+}
+
+void CompositeCheckpointsTest::testBudget()
+{
+    const auto base = baseImage();
+    const auto allTiles = CompositeCheckpoints::updatedTiles(base, base.rect(), {});
+    const auto tileBytes = allTiles.value(QPoint{0, 0}).sizeInBytes();
+
+    CompositeCheckpoints checkpoints(tileBytes * 2);
+    checkpoints.insert({1, {1, {1}}, CompositeCheckpoints::updatedTiles(base, QRect{0, 0, 1, 1}, {})});
+    const auto first = checkpoints.find(1, [](const Checkpoint &) { return true; });
+    // Shares its first tile with the first checkpoint.
+    checkpoints.insert({2, {1, {1, 2}}, CompositeCheckpoints::updatedTiles(base, QRect{300, 0, 1, 1}, first->tiles)});
+    QCOMPARE(checkpoints.bytes(), tileBytes * 2);
+    QVERIFY(checkpoints.find(1, [](const Checkpoint &) { return true; }));
+
+    // Goes over the budget, so the least recently used checkpoint is dropped.
+    checkpoints.insert({3, {1, {1, 3}}, CompositeCheckpoints::updatedTiles(base, QRect{0, 300, 1, 1}, {})});
+    QVERIFY(checkpoints.bytes() <= tileBytes * 2);
+    QCOMPARE(checkpoints.find(2, [](const Checkpoint &) { return true; })->position, qsizetype(1));
+
+    checkpoints.setByteBudget(0);
+    QCOMPARE(checkpoints.bytes(), qsizetype(0));
+    QVERIFY(!checkpoints.find(3, [](const Checkpoint &) { return true; }));
+}
+
+QTEST_GUILESS_MAIN(CompositeCheckpointsTest)
+
+#include "compositecheckpointstest.moc"
@@ -0,0 +1,146 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "../src/annotations/effectcache.h"
+
+#include <QImage>
+#include <QObject>
+#include <QTest>
+
+class EffectCacheTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testFind();
+    void testKeys();
+    void testEviction();
+    void testBudget();
+};
+
+static EffectCache::Key key(int n)
+{
+    return {0, {1, {quint64(n)}}, QRect{0, 0, 16, 16}, 0.5, 1};
+}
+
+// 1 KiB
+static QImage image()
+{
+    QImage image(16, 16, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::red);
+    return image;
+}
+
+void EffectCacheTest::testFind()
+{
+    EffectCache cache;
+    QVERIFY(cache.find(key(1)).isNull());
+    const auto result = image();
+    cache.insert(key(1), result);
+    QCOMPARE(cache.find(key(1)).cacheKey(), result.cacheKey());
+    QVERIFY(cache.find(key(2)).isNull());
+
+    const auto stats = cache.stats();
+    QCOMPARE(stats.hits, qint64(1));
+    QCOMPARE(stats.misses, qint64(2));
+    QCOMPARE(stats.count, qsizetype(1));
+    QCOMPARE(stats.bytes, result.sizeInBytes());
+
+    // Replacing a result doesn't count it twice.
+    cache.insert(key(1), image());
+    QCOMPARE(cache.stats().count, qsizetype(1));
+    QCOMPARE(cache.stats().bytes, result.sizeInBytes());
+
+    // Removing isn't evicting.
+    cache.insert(key(2), image());
+    cache.remove(key(2));
+    cache.remove(key(3));
+    QVERIFY(cache.find(key(2)).isNull());
+    QCOMPARE(cache.stats().count, qsizetype(1));
+    QCOMPARE(cache.stats().bytes, result.sizeInBytes());
+    QCOMPARE(cache.stats().evictions, qint64(0));
+
+    cache.clear();
+    QVERIFY(cache.find(key(1)).isNull());
+    QCOMPARE(cache.stats().bytes, qsizetype(0));
+    cache.resetStats();
+    QCOMPARE(cache.stats().misses, qint64(0));
+}
+
+void EffectCacheTest::testKeys()
+{
+    EffectCache cache;
+    const auto base = key(1);
+    cache.insert(base, image());
+    auto other = base;
+    other.effect = 1;
+    QVERIFY(cache.find(other).isNull());
+    other = base;
+    other.sources.imageKey = 2;
+    QVERIFY(cache.find(other).isNull());
+    other = base;
+    other.sources.revisions.append(2);
+    QVERIFY(cache.find(other).isNull());
+    other = base;
+    other.rect.translate(1, 0);
+    QVERIFY(cache.find(other).isNull());
+    other = base;
+    other.strength = 0.75;
+    QVERIFY(cache.find(other).isNull());
+    other = base;
+    other.dpr = 2;
+    QVERIFY(cache.find(other).isNull());
+    other = base;
+    other.quality = Traits::ImageEffects::Quality::Interactive;
+    QVERIFY(cache.find(other).isNull());
+    QVERIFY(!cache.find(base).isNull());
+}
+
+void EffectCacheTest::testEviction()
+{
+    const auto bytes = image().sizeInBytes();
+    EffectCache cache(bytes * 3);
+    cache.insert(key(1), image());
+    cache.insert(key(2), image());
+    cache.insert(key(3), image());
+    // Makes 1 more recently used than 2.
+    QVERIFY(!cache.find(key(1)).isNull());
+    cache.insert(key(4), image());
+
+    QVERIFY(cache.find(key(2)).isNull());
+    QVERIFY(!cache.find(key(1)).isNull());
+    QVERIFY(!cache.find(key(3)).isNull());
+    QVERIFY(!cache.find(key(4)).isNull());
+    QCOMPARE(cache.stats().evictions, qint64(1));
+    QCOMPARE(cache.stats().bytes, bytes * 3);
+
+    // Too big to ever fit.
+    cache.insert(key(5), QImage(64, 64, QImage::Format_ARGB32_Premultiplied));
+    QVERIFY(cache.find(key(5)).isNull());
+    QCOMPARE(cache.stats().count, qsizetype(3));
+}
+
+void EffectCacheTest::testBudget()
+{
+    const auto bytes = image().sizeInBytes();
+    EffectCache cache(bytes * 4);
+    for (int i = 0; i < 4; ++i) {
+        cache.insert(key(i), image());
+    }
+    cache.setByteBudget(bytes * 2);
+    QCOMPARE(cache.byteBudget(), bytes * 2);
+    QCOMPARE(cache.stats().count, qsizetype(2));
+    QCOMPARE(cache.stats().evictions, qint64(2));
+    // The oldest ones are dropped.
+    QVERIFY(cache.find(key(0)).isNull());
+    QVERIFY(cache.find(key(1)).isNull());
+    QVERIFY(!cache.find(key(2)).isNull());
+    QVERIFY(!cache.find(key(3)).isNull());
+
+    cache.setByteBudget(0);
+    QCOMPARE(cache.stats().count, qsizetype(0));
+    QCOMPARE(cache.stats().bytes, qsizetype(0));
+}
+
+QTEST_GUILESS_MAIN(EffectCacheTest)
+
+#include "effectcachetest.moc"
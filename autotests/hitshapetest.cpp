@@ -0,0 +1,88 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "../src/annotations/hitshape.h"
+
+#include <QObject>
+#include <QPainterPath>
+#include <QTest>
+#include <QTransform>
+
+class HitShapeTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testLines();
+    void testFilled();
+    void testTransform();
+};
+
+void HitShapeTest::testLines()
+{
+    HitShape shape;
+    QVERIFY(shape.isEmpty());
+    QVERIFY(!shape.contains({0, 0}));
+    QCOMPARE(shape.boundingRect(), QRectF());
+
+    QPainterPath path({0, 0});
+    path.lineTo(100, 0);
+    shape.addPath(path, false);
+    shape.setHalfWidth(5);
+    QCOMPARE(shape.boundingRect(), QRectF(-5, -5, 110, 10));
+    QVERIFY(shape.contains({50, 5}));
+    QVERIFY(!shape.contains({50, 5.1}));
+    // Round at the ends.
+    QVERIFY(shape.contains({103, 3}));
+    QVERIFY(!shape.contains({104, 4}));
+    QVERIFY(shape.contains({50, 8}, 3));
+    QVERIFY(!shape.contains({50, 8.1}, 3));
+}
+
+void HitShapeTest::testFilled()
+{
+    // Open like a freehand path, but the inside still counts.
+    QPainterPath path({0, 0});
+    path.lineTo(0, 100);
+    path.lineTo(100, 100);
+    path.lineTo(100, 0);
+    HitShape shape;
+    shape.addPath(path, true);
+    shape.setHalfWidth(0.5);
+    QVERIFY(shape.contains({50, 50}));
+    QVERIFY(shape.contains({100.5, 50}));
+    QVERIFY(!shape.contains({101, 50}));
+    QVERIFY(shape.contains({50, -2}, 2));
+
+    // Winding fill, so overlapping subpaths don't cancel each other out.
+    QPainterPath overlapping;
+    overlapping.addRect(0, 0, 100, 100);
+    overlapping.addRect(25, 25, 50, 50);
+    HitShape windingShape;
+    windingShape.addPath(overlapping, true);
+    QVERIFY(windingShape.contains({50, 50}));
+    QVERIFY(!windingShape.contains({150, 50}));
+}
+
+void HitShapeTest::testTransform()
+{
+    QPainterPath path;
+    path.addRect(0, 0, 10, 10);
+    HitShape shape;
+    shape.addPath(path, true);
+    shape.setHalfWidth(1);
+
+    shape.translate(100, 0);
+    QCOMPARE(shape.boundingRect(), QRectF(99, -1, 12, 12));
+    QVERIFY(shape.contains({105, 5}));
+    QVERIFY(!shape.contains({5, 5}));
+
+    shape.transform(QTransform::fromScale(2, 2));
+    // The half width stays the same.
+    QCOMPARE(shape.boundingRect(), QRectF(199, -1, 22, 22));
+    QVERIFY(shape.contains({215, 15}));
+    QCOMPARE(shape.halfWidth(), 1.0);
+}
+
+QTEST_GUILESS_MAIN(HitShapeTest)
+
+#include "hitshapetest.moc"
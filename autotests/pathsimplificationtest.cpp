@@ -0,0 +1,113 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "../src/annotations/pathsimplification.h"
+
+#include <QLineF>
+#include <QObject>
+#include <QPolygonF>
+#include <QTest>
+#include <QtMath>
+
+#include <algorithm>
+#include <limits>
+
+using namespace Qt::StringLiterals;
+
+class PathSimplificationTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testFreehand();
+    void testCorners();
+    void testShortPaths();
+};
+
+// The distance from `point` to the closest line of `polygon`.
+static qreal distance(const QPointF &point, const QPolygonF &polygon)
+{
+    qreal distance = std::numeric_limits<qreal>::max();
+    for (qsizetype i = 1; i < polygon.size(); ++i) {
+        const QLineF line{polygon[i - 1], polygon[i]};
+        const auto t = std::clamp(QPointF::dotProduct(point - line.p1(), line.p2() - line.p1()) //
+                                      / qMax(QPointF::dotProduct(line.p2() - line.p1(), line.p2() - line.p1()), 1e-12),
+                                  0.0,
+                                  1.0);
+        distance = std::min(distance, QLineF(point, line.pointAt(t)).length());
+    }
+    return distance;
+}
+
+// Made like AnnotationDocument::continueItem() makes freehand paths.
+static QPainterPath freehandPath(const QList<QPointF> &points)
+{
+    QPainterPath path(points.first());
+    for (qsizetype i = 1; i < points.size(); ++i) {
+        const auto lastElement = path.elementAt(path.elementCount() - 1);
+        path.quadTo(lastElement, (lastElement + points[i]) / 2);
+    }
+    return path;
+}
+
+void PathSimplificationTest::testFreehand()
+{
+    // A spiral with points less than half a pixel apart, like from mouse moves.
+    QList<QPointF> points;
+    for (int i = 0; i < 3000; ++i) {
+        const qreal angle = i * 3 * M_PI / 3000;
+        const qreal radius = 50 + angle * 10;
+        points.append({radius * qCos(angle), radius * qSin(angle)});
+    }
+    const auto path = freehandPath(points);
+    const qreal tolerance = 0.25;
+    const auto simplified = PathSimplification::simplified(path, tolerance);
+    QVERIFY2(simplified.elementCount() * 10 < path.elementCount(),
+             qPrintable(u"%1 elements from %2"_s.arg(simplified.elementCount()).arg(path.elementCount())));
+    QCOMPARE(QPointF(simplified.elementAt(0)), QPointF(path.elementAt(0)));
+    QCOMPARE(simplified.currentPosition(), path.currentPosition());
+
+    // The simplified path goes through all of the points of the original path.
+    const auto polygon = simplified.toSubpathPolygons().constFirst();
+    for (int i = 0; i < path.elementCount(); ++i) {
+        const auto element = path.elementAt(i);
+        if (element.isCurveTo()) {
+            i += 2;
+        }
+        QVERIFY(distance(path.elementAt(i), polygon) <= tolerance + 0.05);
+    }
+}
+
+void PathSimplificationTest::testCorners()
+{
+    QPainterPath path({0, 0});
+    for (int i = 1; i <= 100; ++i) {
+        path.lineTo(i, 0);
+    }
+    for (int i = 1; i <= 100; ++i) {
+        path.lineTo(100, i);
+    }
+    const auto simplified = PathSimplification::simplified(path, 0.5);
+    QPainterPath expected({0, 0});
+    expected.lineTo(100, 0);
+    expected.lineTo(100, 100);
+    QCOMPARE(simplified, expected);
+}
+
+void PathSimplificationTest::testShortPaths()
+{
+    // Nothing to simplify.
+    QPainterPath line({0, 0});
+    line.lineTo(10, 10);
+    QCOMPARE(PathSimplification::simplified(line, 0.5), line);
+
+    // A click without moving leaves a dot.
+    const auto dot = freehandPath({{5, 5}, {5, 5}, {5, 5}});
+    const auto simplified = PathSimplification::simplified(dot, 0.5);
+    QVERIFY(!simplified.isEmpty());
+    QCOMPARE(simplified.elementCount(), 2);
+    QCOMPARE(simplified.currentPosition(), QPointF(5, 5));
+}
+
+QTEST_GUILESS_MAIN(PathSimplificationTest)
+
+#include "pathsimplificationtest.moc"
@@ -0,0 +1,154 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "../src/annotations/pixelate.h"
+
+#include <QColor>
+#include <QImage>
+#include <QObject>
+#include <QRandomGenerator>
+#include <QTest>
+
+class PixelateTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testBlockAverages_data();
+    void testBlockAverages();
+    void testRectMatchesWhole_data();
+    void testRectMatchesWhole();
+    void benchmarkPixelate_data();
+    void benchmarkPixelate();
+};
+
+// Opaque noise, so that averaging premultiplied and unpremultiplied colors gives the same result.
+static QImage opaqueNoiseImage(const QSize &size, QImage::Format format)
+{
+    QImage image(size, format);
+    QRandomGenerator random(size.width() * size.height());
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            const auto rgb = random.generate64();
+            image.setPixelColor(x, y, QColor::fromRgba64(rgb, rgb >> 16, rgb >> 32));
+        }
+    }
+    return image;
+}
+
+void PixelateTest::testBlockAverages_data()
+{
+    QTest::addColumn<int>("format");
+    QTest::addColumn<int>("blockSize");
+    QTest::addColumn<double>("tolerance");
+
+    const QList<std::tuple<const char *, QImage::Format, double>> formats{
+        {"RGBA8888_Premultiplied", QImage::Format_RGBA8888_Premultiplied, 1 / 255.0},
+        {"ARGB32", QImage::Format_ARGB32, 1 / 255.0},
+        {"RGB888", QImage::Format_RGB888, 1 / 255.0},
+        {"RGBA64_Premultiplied", QImage::Format_RGBA64_Premultiplied, 1 / 65535.0},
+        {"RGBA16FPx4_Premultiplied", QImage::Format_RGBA16FPx4_Premultiplied, 1e-3},
+        {"RGBA32FPx4_Premultiplied", QImage::Format_RGBA32FPx4_Premultiplied, 1 / 65535.0},
+    };
+    for (const auto &[name, format, tolerance] : formats) {
+        for (int blockSize : {2, 7, 32}) {
+            QTest::addRow("%s-%d", name, blockSize) << int(format) << blockSize << tolerance;
+        }
+    }
+}
+
+void PixelateTest::testBlockAverages()
+{
+    QFETCH(int, format);
+    QFETCH(int, blockSize);
+    QFETCH(double, tolerance);
+
+    // Sizes that aren't multiples of the block size, so the last blocks are smaller.
+    const auto source = opaqueNoiseImage({97, 61}, QImage::Format(format));
+    auto image = source;
+    Pixelation::pixelate(image, blockSize);
+    QCOMPARE(image.format(), source.format());
+    QCOMPARE(image.size(), source.size());
+
+    for (int top = 0; top < source.height(); top += blockSize) {
+        for (int left = 0; left < source.width(); left += blockSize) {
+            const QRect block = QRect(left, top, blockSize, blockSize).intersected(source.rect());
+            double sums[3] = {};
+            for (int y = block.top(); y <= block.bottom(); ++y) {
+                for (int x = block.left(); x <= block.right(); ++x) {
+                    const auto color = source.pixelColor(x, y);
+                    sums[0] += color.redF();
+                    sums[1] += color.greenF();
+                    sums[2] += color.blueF();
+                }
+            }
+            const double count = block.width() * block.height();
+            for (int y = block.top(); y <= block.bottom(); ++y) {
+                for (int x = block.left(); x <= block.right(); ++x) {
+                    const auto color = image.pixelColor(x, y);
+                    QVERIFY(std::abs(color.redF() - sums[0] / count) <= tolerance);
+                    QVERIFY(std::abs(color.greenF() - sums[1] / count) <= tolerance);
+                    QVERIFY(std::abs(color.blueF() - sums[2] / count) <= tolerance);
+                    QCOMPARE(color.alpha(), 255);
+                }
+            }
+        }
+    }
+}
+
+void PixelateTest::testRectMatchesWhole_data()
+{
+    QTest::addColumn<int>("format");
+    QTest::addColumn<QRect>("rect");
+    QTest::addColumn<int>("maxThreads");
+
+    const QList<std::pair<const char *, QImage::Format>> formats{
+        {"RGBA8888_Premultiplied", QImage::Format_RGBA8888_Premultiplied},
+        {"ARGB32", QImage::Format_ARGB32},
+        {"RGBA64_Premultiplied", QImage::Format_RGBA64_Premultiplied},
+        {"RGBA32FPx4_Premultiplied", QImage::Format_RGBA32FPx4_Premultiplied},
+    };
+    // Aligned to the blocks, not aligned, on the edge of the image and partially outside of it.
+    const QList<QRect> rects{{14, 7, 28, 21}, {13, 5, 50, 31}, {90, 50, 7, 11}, {-5, -5, 20, 20}};
+    for (const auto &[name, format] : formats) {
+        for (const auto &rect : rects) {
+            for (int maxThreads : {1, 3}) {
+                QTest::addRow("%s-%d,%d-%d", name, rect.x(), rect.y(), maxThreads) << int(format) << rect << maxThreads;
+            }
+        }
+    }
+}
+
+void PixelateTest::testRectMatchesWhole()
+{
+    QFETCH(int, format);
+    QFETCH(QRect, rect);
+    QFETCH(int, maxThreads);
+
+    const auto source = opaqueNoiseImage({97, 61}, QImage::Format(format));
+    auto whole = source;
+    Pixelation::pixelate(whole, 7);
+    const auto actual = Pixelation::pixelated(source, rect, 7, maxThreads);
+    QCOMPARE(actual, whole.copy(rect.intersected(source.rect())));
+}
+
+void PixelateTest::benchmarkPixelate_data()
+{
+    QTest::addColumn<QRect>("rect");
+    QTest::newRow("whole") << QRect{0, 0, 3840, 2160};
+    QTest::newRow("rect") << QRect{1000, 500, 400, 200};
+}
+
+void PixelateTest::benchmarkPixelate()
+{
+    QFETCH(QRect, rect);
+
+    QImage image({3840, 2160}, QImage::Format_RGBA8888_Premultiplied);
+    image.fill(Qt::red);
+    QBENCHMARK {
+        Pixelation::pixelated(image, rect, 16);
+    }
+}
+
+QTEST_GUILESS_MAIN(PixelateTest)
+
+#include "pixelatetest.moc"
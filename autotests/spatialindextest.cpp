@@ -0,0 +1,101 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "../src/annotations/spatialindex.h"
+
+#include <QObject>
+#include <QRandomGenerator>
+#include <QTest>
+
+#include <algorithm>
+
+class SpatialIndexTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testQueries();
+    void testUpdates();
+    void testRandom();
+};
+
+using Positions = QList<qsizetype>;
+
+void SpatialIndexTest::testQueries()
+{
+    SpatialIndex index(100);
+    index.insert(0, {10, 10, 50, 50});
+    index.insert(1, {150, 150, 100, 100});
+    // Spans many cells and is checked by every query.
+    index.insert(2, {-100000, -100000, 200000, 200000});
+    index.insert(3, {40, 40, 200, 20});
+
+    QCOMPARE(index.size(), qsizetype(4));
+    QCOMPARE(index.containing({20, 20}), (Positions{0, 2}));
+    QCOMPARE(index.containing({200, 200}), (Positions{1, 2}));
+    // Edges count.
+    QCOMPARE(index.containing({60, 60}), (Positions{0, 2, 3}));
+    QCOMPARE(index.intersecting({0, 0, 300, 300}), (Positions{0, 1, 2, 3}));
+    QCOMPARE(index.intersecting({300, 300, 10, 10}), (Positions{2}));
+    QCOMPARE(index.intersecting({1000000, 0, 10, 10}), Positions{});
+}
+
+void SpatialIndexTest::testUpdates()
+{
+    SpatialIndex index(100);
+    index.insert(0, {10, 10, 50, 50});
+    index.insert(1, {10, 10, 50, 50});
+    QCOMPARE(index.containing({20, 20}), (Positions{0, 1}));
+
+    // Moved out of the cell.
+    index.insert(1, {510, 510, 50, 50});
+    QCOMPARE(index.size(), qsizetype(2));
+    QCOMPARE(index.rect(1), QRectF(510, 510, 50, 50));
+    QCOMPARE(index.containing({20, 20}), (Positions{0}));
+    QCOMPARE(index.containing({520, 520}), (Positions{1}));
+
+    index.remove(0);
+    QVERIFY(!index.contains(0));
+    QCOMPARE(index.containing({20, 20}), Positions{});
+    // Removing again does nothing.
+    index.remove(0);
+    QCOMPARE(index.size(), qsizetype(1));
+
+    index.clear();
+    QCOMPARE(index.size(), qsizetype(0));
+    QCOMPARE(index.containing({520, 520}), Positions{});
+}
+
+// The same results as checking every rect.
+void SpatialIndexTest::testRandom()
+{
+    SpatialIndex index(64);
+    QHash<qsizetype, QRectF> rects;
+    auto *random = QRandomGenerator::global();
+    auto randomRect = [random] {
+        return QRectF(random->bounded(2000.0) - 500, random->bounded(2000.0) - 500, random->bounded(300.0), random->bounded(300.0));
+    };
+    for (qsizetype i = 0; i < 500; ++i) {
+        rects.insert(i, randomRect());
+        index.insert(i, rects[i]);
+    }
+    for (qsizetype i = 0; i < 500; i += 3) {
+        rects.remove(i);
+        index.remove(i);
+    }
+    for (int i = 0; i < 100; ++i) {
+        const auto query = randomRect();
+        Positions expected;
+        for (auto it = rects.cbegin(); it != rects.cend(); ++it) {
+            if (it->left() <= query.right() && query.left() <= it->right() //
+                && it->top() <= query.bottom() && query.top() <= it->bottom()) {
+                expected.append(it.key());
+            }
+        }
+        std::ranges::sort(expected);
+        QCOMPARE(index.intersecting(query), expected);
+    }
+}
+
+QTEST_GUILESS_MAIN(SpatialIndexTest)
+
+#include "spatialindextest.moc"
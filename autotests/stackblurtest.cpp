@@ -3,20 +3,737 @@
 
 #include "../src/annotations/stackblur.h"
 
+#include <QColor>
+#include <QFloat16>
 #include <QObject>
 #include <QPainter>
+#include <QRandomGenerator>
 #include <QTest>
 
+#ifdef HAVE_OPENCV
+#include <opencv2/imgproc.hpp>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <type_traits>
+
+using namespace Qt::StringLiterals;
+
 class StackBlurTest : public QObject
 {
     Q_OBJECT
 private Q_SLOTS:
+    void testScanlineMatchesReference_data();
+    void testScanlineMatchesReference();
+    void testParallelMatchesSerial_data();
+    void testParallelMatchesSerial();
+    void testAlpha8MatchesRgba_data();
+    void testAlpha8MatchesRgba();
+    void testRoiMatchesFull_data();
+    void testRoiMatchesFull();
+    void testScratchIsReused();
+    void testScratchIsTrimmed();
+    void testLargeRadius_data();
+    void testLargeRadius();
+    void testWideFormats_data();
+    void testWideFormats();
+    void testBackendNames();
+    void testAutoBackend();
+    void testBackendsAgree_data();
+    void testBackendsAgree();
+    void benchmarkStackBlur_data();
     void benchmarkStackBlur();
+    void benchmarkImplementations_data();
+    void benchmarkImplementations();
+    void benchmarkPasses_data();
+    void benchmarkPasses();
+    void benchmarkRoi();
 };
 
+// Implementations to compare, -1 means referenceBlur(), -2 means the default blur()
+// and -3 means the default parallelBlur().
+static constexpr int referenceImpl = -1;
+static constexpr int defaultImpl = -2;
+static constexpr int parallelImpl = -3;
+
+static QList<std::pair<QString, int>> supportedImpls()
+{
+    using StackBlur::Simd;
+    static const std::pair<QString, Simd> simds[] = {
+        {u"none"_s, Simd::None},
+        {u"sse2"_s, Simd::SSE2},
+        {u"avx2"_s, Simd::AVX2},
+        {u"neon"_s, Simd::NEON},
+    };
+    QList<std::pair<QString, int>> impls;
+    for (const auto &[name, simd] : simds) {
+        if (StackBlur::isSupported(simd)) {
+            impls.emplace_back(name, int(simd));
+        }
+    }
+    return impls;
+}
+
+static void blurWith(int impl, QImage &image, const QSize &kernelSize)
+{
+    if (impl == referenceImpl) {
+        StackBlur::referenceBlur(image, kernelSize);
+    } else if (impl == defaultImpl) {
+        StackBlur::blur(image, kernelSize);
+    } else if (impl == parallelImpl) {
+        StackBlur::parallelBlur(image, kernelSize);
+    } else {
+        StackBlur::blur(image, kernelSize, StackBlur::Simd(impl));
+    }
+}
+
+// Kernel sizes are twice the radius plus one.
+static int kernelRadius(int kernelSize)
+{
+    return std::max(kernelSize, 0) / 2;
+}
+
+static QImage noiseImage(const QSize &size, QImage::Format format)
+{
+    QImage image(size, format);
+    QRandomGenerator random(size.width() * size.height());
+    for (int y = 0; y < image.height(); ++y) {
+        auto line = reinterpret_cast<quint32 *>(image.scanLine(y));
+        random.fillRange(line, image.bytesPerLine() / sizeof(quint32));
+    }
+    return image;
+}
+
+void StackBlurTest::testScanlineMatchesReference_data()
+{
+    QTest::addColumn<int>("impl");
+    QTest::addColumn<int>("format");
+    QTest::addColumn<QSize>("kernelSize");
+
+    const QList<std::pair<const char *, QImage::Format>> formats{
+        {"RGBA8888_Premultiplied", QImage::Format_RGBA8888_Premultiplied},
+        {"RGBA8888", QImage::Format_RGBA8888},
+        {"ARGB32_Premultiplied", QImage::Format_ARGB32_Premultiplied},
+        {"ARGB32", QImage::Format_ARGB32},
+        {"RGB32", QImage::Format_RGB32},
+        {"Alpha8", QImage::Format_Alpha8},
+    };
+    const QList<QSize> kernelSizes{{2, 2}, {3, 3}, {13, 13}, {121, 121}, {509, 509}, {7, 0}, {0, 9}, {31, 5}};
+    for (const auto &[name, impl] : supportedImpls()) {
+        for (const auto &[formatName, format] : formats) {
+            for (const auto &kernelSize : kernelSizes) {
+                QTest::addRow("%s-%s-%dx%d", qPrintable(name), formatName, kernelSize.width(), kernelSize.height()) << impl << int(format) << kernelSize;
+            }
+        }
+    }
+}
+
+void StackBlurTest::testScanlineMatchesReference()
+{
+    QFETCH(int, impl);
+    QFETCH(int, format);
+    QFETCH(QSize, kernelSize);
+
+    // Odd sizes so that kernels working on multiple lines at once have a remainder.
+    const auto source = noiseImage({97, 61}, QImage::Format(format));
+    auto expected = source;
+    StackBlur::referenceBlur(expected, kernelSize);
+    auto actual = source;
+    blurWith(impl, actual, kernelSize);
+    QCOMPARE(actual, expected);
+}
+
+void StackBlurTest::testParallelMatchesSerial_data()
+{
+    QTest::addColumn<int>("impl");
+    QTest::addColumn<int>("maxThreads");
+    QTest::addColumn<QSize>("kernelSize");
+
+    const QList<QSize> kernelSizes{{3, 3}, {121, 121}, {7, 0}, {0, 9}};
+    for (const auto &[name, impl] : supportedImpls()) {
+        for (int maxThreads : {0, 2, 3, 8}) {
+            for (const auto &kernelSize : kernelSizes) {
+                QTest::addRow("%s-%d-%dx%d", qPrintable(name), maxThreads, kernelSize.width(), kernelSize.height()) << impl << maxThreads << kernelSize;
+            }
+        }
+    }
+}
+
+void StackBlurTest::testParallelMatchesSerial()
+{
+    QFETCH(int, impl);
+    QFETCH(int, maxThreads);
+    QFETCH(QSize, kernelSize);
+
+    // Sizes that don't divide evenly into bands.
+    const auto source = noiseImage({233, 171}, QImage::Format_RGBA8888_Premultiplied);
+    auto expected = source;
+    StackBlur::blur(expected, kernelSize, StackBlur::Simd(impl));
+    auto actual = source;
+    StackBlur::parallelBlur(actual, kernelSize, StackBlur::Simd(impl), maxThreads);
+    QCOMPARE(actual, expected);
+}
+
+void StackBlurTest::testAlpha8MatchesRgba_data()
+{
+    QTest::addColumn<int>("impl");
+    QTest::addColumn<QSize>("kernelSize");
+
+    const QList<QSize> kernelSizes{{3, 3}, {13, 13}, {121, 121}, {7, 0}, {0, 9}};
+    for (const auto &[name, impl] : supportedImpls()) {
+        for (const auto &kernelSize : kernelSizes) {
+            QTest::addRow("%s-%dx%d", qPrintable(name), kernelSize.width(), kernelSize.height()) << impl << kernelSize;
+        }
+    }
+}
+
+void StackBlurTest::testAlpha8MatchesRgba()
+{
+    QFETCH(int, impl);
+    QFETCH(QSize, kernelSize);
+
+    // Widths that aren't a multiple of 4 columns.
+    const auto source = noiseImage({97, 61}, QImage::Format_RGBA8888_Premultiplied);
+    auto expected = source;
+    StackBlur::blur(expected, kernelSize, StackBlur::Simd(impl));
+    expected.convertTo(QImage::Format_Alpha8);
+    auto actual = source.convertToFormat(QImage::Format_Alpha8);
+    StackBlur::blur(actual, kernelSize, StackBlur::Simd(impl));
+    QCOMPARE(actual, expected);
+}
+
+void StackBlurTest::testRoiMatchesFull_data()
+{
+    QTest::addColumn<int>("format");
+    QTest::addColumn<QRect>("roi");
+    QTest::addColumn<QSize>("kernelSize");
+
+    const QList<std::pair<const char *, QImage::Format>> formats{
+        {"RGBA8888_Premultiplied", QImage::Format_RGBA8888_Premultiplied},
+        {"ARGB32", QImage::Format_ARGB32},
+        {"Alpha8", QImage::Format_Alpha8},
+    };
+    const QList<std::pair<const char *, QRect>> rois{
+        {"inside", {40, 30, 50, 20}},
+        {"topLeft", {0, 0, 21, 13}},
+        {"bottomRight", {150, 100, 83, 71}},
+        {"partlyOutside", {200, -10, 100, 50}},
+        {"whole", {0, 0, 233, 171}},
+    };
+    const QList<QSize> kernelSizes{{3, 3}, {45, 45}, {7, 0}, {0, 9}};
+    for (const auto &[formatName, format] : formats) {
+        for (const auto &[roiName, roi] : rois) {
+            for (const auto &kernelSize : kernelSizes) {
+                QTest::addRow("%s-%s-%dx%d", formatName, roiName, kernelSize.width(), kernelSize.height()) << int(format) << roi << kernelSize;
+            }
+        }
+    }
+}
+
+void StackBlurTest::testRoiMatchesFull()
+{
+    QFETCH(int, format);
+    QFETCH(QRect, roi);
+    QFETCH(QSize, kernelSize);
+
+    const auto source = noiseImage({233, 171}, QImage::Format(format));
+    auto blurred = source;
+    StackBlur::blur(blurred, kernelSize);
+    // The source outside of the ROI and the fully blurred image inside of it.
+    auto expected = source;
+    const QRect clippedRoi = roi.intersected(source.rect());
+    const qsizetype bytesPerPixel = source.depth() / 8;
+    for (int y = clippedRoi.top(); y <= clippedRoi.bottom(); ++y) {
+        std::memcpy(expected.scanLine(y) + clippedRoi.left() * bytesPerPixel,
+                    blurred.constScanLine(y) + clippedRoi.left() * bytesPerPixel,
+                    clippedRoi.width() * bytesPerPixel);
+    }
+
+    auto actual = source;
+    StackBlur::blur(actual, roi, kernelSize);
+    QCOMPARE(actual, expected);
+    actual = source;
+    StackBlur::parallelBlur(actual, roi, kernelSize, 4);
+    QCOMPARE(actual, expected);
+}
+
+void StackBlurTest::testScratchIsReused()
+{
+    const auto source = noiseImage({97, 61}, QImage::Format_RGBA8888_Premultiplied);
+    const qsizetype bufferBytes = 97 * 61 * 4;
+    StackBlur::Scratch scratch;
+    const auto before = StackBlur::scratchStats();
+    auto image = source;
+    StackBlur::parallelBlur(image, image.rect(), {13, 13}, scratch);
+    QCOMPARE(scratch.stats().bytes, bufferBytes);
+    QCOMPARE(scratch.stats().allocations, qsizetype(1));
+    QCOMPARE(StackBlur::scratchStats().bytes, before.bytes + bufferBytes);
+    QVERIFY(StackBlur::scratchStats().peakBytes >= before.bytes + bufferBytes);
+
+    // Blurring the same or a smaller area again doesn't allocate.
+    image = source;
+    StackBlur::parallelBlur(image, image.rect(), {13, 13}, scratch);
+    StackBlur::parallelBlur(image, {10, 10, 20, 20}, {3, 3}, scratch, 2);
+    QCOMPARE(scratch.stats().allocations, qsizetype(1));
+
+    auto expected = source;
+    StackBlur::blur(expected, {13, 13});
+    StackBlur::blur(expected, {10, 10, 20, 20}, {3, 3});
+    QCOMPARE(image, expected);
+
+    const auto beforeRelease = StackBlur::scratchStats();
+    scratch.release();
+    QCOMPARE(scratch.stats().bytes, qsizetype(0));
+    QCOMPARE(scratch.stats().peakBytes, bufferBytes);
+    QCOMPARE(StackBlur::scratchStats().bytes, beforeRelease.bytes - bufferBytes);
+}
+
+void StackBlurTest::testScratchIsTrimmed()
+{
+    const auto source = noiseImage({97, 61}, QImage::Format_RGBA8888_Premultiplied);
+    const qsizetype bufferBytes = 97 * 61 * 4;
+    StackBlur::Scratch scratch;
+    scratch.setMaxRetainedBytes(bufferBytes - 1);
+    const auto before = StackBlur::scratchStats();
+    auto image = source;
+    StackBlur::parallelBlur(image, image.rect(), {13, 13}, StackBlur::Backend::Scanline, scratch);
+    // Used for the blur, but too large to keep afterwards.
+    QCOMPARE(scratch.stats().bytes, qsizetype(0));
+    QCOMPARE(scratch.stats().peakBytes, bufferBytes);
+    QCOMPARE(scratch.stats().allocations, qsizetype(1));
+    QCOMPARE(StackBlur::scratchStats().bytes, before.bytes);
+
+    auto expected = source;
+    StackBlur::blur(expected, {13, 13});
+    QCOMPARE(image, expected);
+
+    // Smaller buffers are kept.
+    StackBlur::parallelBlur(image, {10, 10, 20, 20}, {3, 3}, StackBlur::Backend::Scanline, scratch);
+    QCOMPARE(scratch.stats().bytes, qsizetype(20 * 22 * 4));
+    StackBlur::parallelBlur(image, {10, 10, 20, 20}, {3, 3}, StackBlur::Backend::Scanline, scratch);
+    QCOMPARE(scratch.stats().allocations, qsizetype(2));
+}
+
+void StackBlurTest::testLargeRadius_data()
+{
+    QTest::addColumn<int>("format");
+    QTest::addColumn<QSize>("kernelSize");
+
+    QTest::newRow("RGBA8888_Premultiplied-601x601") << int(QImage::Format_RGBA8888_Premultiplied) << QSize(601, 601);
+    QTest::newRow("RGBA8888_Premultiplied-723x0") << int(QImage::Format_RGBA8888_Premultiplied) << QSize(723, 0);
+    QTest::newRow("RGBA8888_Premultiplied-2001x41") << int(QImage::Format_RGBA8888_Premultiplied) << QSize(2001, 41);
+    QTest::newRow("Alpha8-1201x1201") << int(QImage::Format_Alpha8) << QSize(1201, 1201);
+}
+
+void StackBlurTest::testLargeRadius()
+{
+    QFETCH(int, format);
+    QFETCH(QSize, kernelSize);
+
+    // Transparent on the left half and opaque white on the right half.
+    QImage image({1024, 64}, QImage::Format(format));
+    image.fill(Qt::transparent);
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = image.width() / 2; x < image.width(); ++x) {
+            image.setPixel(x, y, qRgba(255, 255, 255, 255));
+        }
+    }
+    StackBlur::blur(image, kernelSize);
+
+    // The edge is blurred evenly into both sides.
+    const int y = image.height() / 2;
+    int previousAlpha = 0;
+    for (int x = 0; x < image.width(); ++x) {
+        const int alpha = qAlpha(image.pixel(x, y));
+        QVERIFY2(alpha >= previousAlpha - 1, qPrintable(u"x: %1"_s.arg(x)));
+        previousAlpha = alpha;
+    }
+    QVERIFY(qAbs(qAlpha(image.pixel(image.width() / 2, y)) - 128) <= 8);
+    QVERIFY(qAlpha(image.pixel(image.width() / 4, y)) > 0);
+    QVERIFY(qAlpha(image.pixel(image.width() * 3 / 4, y)) < 255);
+}
+
+// Noise with valid premultiplied colors, which also keeps floating point channels in range.
+static QImage colorNoiseImage(const QSize &size, QImage::Format format)
+{
+    QImage image(size, format);
+    QRandomGenerator random(size.width() * size.height());
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            const auto rgba = random.generate64();
+            image.setPixelColor(x, y, QColor::fromRgba64(rgba, rgba >> 16, rgba >> 32, rgba >> 48));
+        }
+    }
+    return image;
+}
+
+template<typename T>
+static T fromDouble(double value)
+{
+    if constexpr (std::is_integral_v<T>) {
+        return T(value + 0.5);
+    } else {
+        return T(float(value));
+    }
+}
+
+// A direct convolution with the stack blur weights for 4 channels of type T, rounded after each pass.
+template<typename T>
+static void naivePass(QImage &image, int radius, bool horizontal)
+{
+    if (radius == 0) {
+        return;
+    }
+    const auto source = image.copy();
+    const double divisor = double(radius + 1) * (radius + 1);
+    for (int y = 0; y < image.height(); ++y) {
+        auto line = reinterpret_cast<T *>(image.scanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            for (int c = 0; c < 4; ++c) {
+                double sum = 0;
+                for (int i = -radius; i <= radius; ++i) {
+                    const int sx = horizontal ? std::clamp(x + i, 0, image.width() - 1) : x;
+                    const int sy = horizontal ? y : std::clamp(y + i, 0, image.height() - 1);
+                    sum += double(reinterpret_cast<const T *>(source.constScanLine(sy))[sx * 4 + c]) * (radius + 1 - std::abs(i));
+                }
+                line[x * 4 + c] = fromDouble<T>(sum / divisor);
+            }
+        }
+    }
+}
+
+template<typename T>
+static double maxDifference(const QImage &a, const QImage &b)
+{
+    double difference = 0;
+    for (int y = 0; y < a.height(); ++y) {
+        auto lineA = reinterpret_cast<const T *>(a.constScanLine(y));
+        auto lineB = reinterpret_cast<const T *>(b.constScanLine(y));
+        for (int x = 0; x < a.width() * 4; ++x) {
+            difference = std::max(difference, std::abs(double(lineA[x]) - double(lineB[x])));
+        }
+    }
+    return difference;
+}
+
+template<typename T>
+static double wideBlurDifference(const QImage &source, const QSize &kernelSize, int maxThreads)
+{
+    auto expected = source;
+    naivePass<T>(expected, kernelRadius(kernelSize.width()), true);
+    naivePass<T>(expected, kernelRadius(kernelSize.height()), false);
+    auto actual = source;
+    StackBlur::parallelBlur(actual, kernelSize, maxThreads);
+    return maxDifference<T>(actual, expected);
+}
+
+void StackBlurTest::testWideFormats_data()
+{
+    QTest::addColumn<int>("format");
+    QTest::addColumn<QSize>("kernelSize");
+    QTest::addColumn<int>("maxThreads");
+
+    const QList<std::pair<const char *, QImage::Format>> formats{
+        {"RGBA64_Premultiplied", QImage::Format_RGBA64_Premultiplied},
+        {"RGBX64", QImage::Format_RGBX64},
+        {"RGBA16FPx4_Premultiplied", QImage::Format_RGBA16FPx4_Premultiplied},
+        {"RGBA32FPx4_Premultiplied", QImage::Format_RGBA32FPx4_Premultiplied},
+    };
+    const QList<QSize> kernelSizes{{3, 3}, {13, 13}, {121, 121}, {7, 0}, {0, 9}};
+    for (const auto &[formatName, format] : formats) {
+        for (const auto &kernelSize : kernelSizes) {
+            for (int maxThreads : {1, 3}) {
+                QTest::addRow("%s-%dx%d-%d", formatName, kernelSize.width(), kernelSize.height(), maxThreads) << int(format) << kernelSize << maxThreads;
+            }
+        }
+    }
+}
+
+void StackBlurTest::testWideFormats()
+{
+    QFETCH(int, format);
+    QFETCH(QSize, kernelSize);
+    QFETCH(int, maxThreads);
+
+    // Wider than a block of columns, with a remainder.
+    const auto source = colorNoiseImage({97, 61}, QImage::Format(format));
+    switch (format) {
+    case QImage::Format_RGBA64_Premultiplied:
+    case QImage::Format_RGBX64:
+        // The sums are exact, so the result is too.
+        QCOMPARE(wideBlurDifference<quint16>(source, kernelSize, maxThreads), 0.0);
+        break;
+    case QImage::Format_RGBA16FPx4_Premultiplied:
+        QVERIFY(wideBlurDifference<qfloat16>(source, kernelSize, maxThreads) <= 1e-3);
+        break;
+    default:
+        QVERIFY(wideBlurDifference<float>(source, kernelSize, maxThreads) <= 1e-6);
+        break;
+    }
+}
+
+void StackBlurTest::testBackendNames()
+{
+    using StackBlur::Backend;
+    for (auto backend : {Backend::Auto, Backend::Scanline, Backend::OpenCV}) {
+        QVERIFY(StackBlur::backendForName(StackBlur::backendName(backend)) == backend);
+    }
+    QVERIFY(StackBlur::backendForName("OpenCV") == Backend::OpenCV);
+    QVERIFY(!StackBlur::backendForName("gpu"));
+    QVERIFY(StackBlur::isAvailable(Backend::Auto));
+    QVERIFY(StackBlur::availableBackends().contains(Backend::Scanline));
+    QVERIFY(!StackBlur::availableBackends().contains(Backend::Auto));
+}
+
+void StackBlurTest::testAutoBackend()
+{
+    using StackBlur::Backend;
+    const QImage image(256, 256, QImage::Format_RGBA8888_Premultiplied);
+    const auto wideImage = image.convertToFormat(QImage::Format_RGBA64_Premultiplied);
+    const auto defaults = StackBlur::autoThresholds();
+    const auto expectedLarge = StackBlur::isAvailable(Backend::OpenCV) ? Backend::OpenCV : Backend::Scanline;
+
+    // The apron counts too.
+    StackBlur::setAutoThresholds({200 * 200, 100 * 100});
+    QCOMPARE(StackBlur::autoBackend(image, {0, 0, 190, 190}, {0, 0}), Backend::Scanline);
+    QCOMPARE(StackBlur::autoBackend(image, {10, 10, 190, 190}, {10, 10}), expectedLarge);
+    QCOMPARE(StackBlur::autoBackend(wideImage, {0, 0, 100, 100}, {0, 0}), expectedLarge);
+    StackBlur::setAutoThresholds(defaults);
+    QCOMPARE(StackBlur::autoBackend(image, image.rect(), {13, 13}), Backend::Scanline);
+}
+
+// The largest difference between the channels of two images, relative to the largest channel value.
+static double maxRelativeDifference(const QImage &a, const QImage &b)
+{
+    switch (a.format()) {
+    case QImage::Format_RGBA64_Premultiplied:
+        return maxDifference<quint16>(a, b) / 65535;
+    case QImage::Format_RGBA32FPx4_Premultiplied:
+        return maxDifference<float>(a, b);
+    default: {
+        const int bytes = a.width() * a.depth() / 8;
+        int difference = 0;
+        for (int y = 0; y < a.height(); ++y) {
+            for (int x = 0; x < bytes; ++x) {
+                difference = std::max(difference, std::abs(a.constScanLine(y)[x] - b.constScanLine(y)[x]));
+            }
+        }
+        return difference / 255.0;
+    }
+    }
+}
+
+void StackBlurTest::testBackendsAgree_data()
+{
+    QTest::addColumn<int>("backend");
+    QTest::addColumn<int>("format");
+    QTest::addColumn<QSize>("kernelSize");
+    QTest::addColumn<QRect>("roi");
+
+    const QList<std::pair<const char *, QImage::Format>> formats{
+        {"RGBA8888_Premultiplied", QImage::Format_RGBA8888_Premultiplied},
+        {"ARGB32", QImage::Format_ARGB32},
+        {"Alpha8", QImage::Format_Alpha8},
+        {"RGBA64_Premultiplied", QImage::Format_RGBA64_Premultiplied},
+        {"RGBA32FPx4_Premultiplied", QImage::Format_RGBA32FPx4_Premultiplied},
+    };
+    const QList<QSize> kernelSizes{{3, 3}, {13, 13}, {7, 0}, {31, 5}};
+    const QList<QRect> rois{{0, 0, 97, 61}, {10, 20, 40, 30}};
+    auto backends = StackBlur::availableBackends();
+    backends.prepend(StackBlur::Backend::Auto);
+    for (auto backend : backends) {
+        for (const auto &[formatName, format] : formats) {
+            for (const auto &kernelSize : kernelSizes) {
+                for (const auto &roi : rois) {
+                    QTest::addRow("%s-%s-%dx%d-%dx%d",
+                                  StackBlur::backendName(backend),
+                                  formatName,
+                                  kernelSize.width(),
+                                  kernelSize.height(),
+                                  roi.width(),
+                                  roi.height())
+                        << int(backend) << int(format) << kernelSize << roi;
+                }
+            }
+        }
+    }
+}
+
+void StackBlurTest::testBackendsAgree()
+{
+    QFETCH(int, backend);
+    QFETCH(int, format);
+    QFETCH(QSize, kernelSize);
+    QFETCH(QRect, roi);
+
+    const auto source = colorNoiseImage({97, 61}, QImage::Format(format));
+    auto expected = source;
+    StackBlur::parallelBlur(expected, roi, kernelSize, StackBlur::Backend::Scanline, StackBlur::threadScratch());
+    auto actual = source;
+    StackBlur::parallelBlur(actual, roi, kernelSize, StackBlur::Backend(backend), StackBlur::threadScratch());
+    if (StackBlur::Backend(backend) == StackBlur::Backend::Scanline) {
+        QCOMPARE(actual, expected);
+    } else {
+        // Backends can round differently, but not by more than an 8-bit step.
+        QVERIFY(maxRelativeDifference(actual, expected) <= 1 / 255.0);
+    }
+
+#ifdef HAVE_OPENCV
+    // OpenCV still blurs like calling cv::stackBlur() with the kernel size did before there were backends.
+    const bool baselineFormat = source.format() == QImage::Format_RGBA8888_Premultiplied || source.format() == QImage::Format_Alpha8;
+    const bool oddKernelSize = kernelSize.width() % 2 == 1 && kernelSize.height() % 2 == 1;
+    if (StackBlur::Backend(backend) == StackBlur::Backend::OpenCV && baselineFormat && oddKernelSize && roi == source.rect()) {
+        auto baseline = source;
+        cv::Mat mat(cv::Size{baseline.width(), baseline.height()},
+                    baseline.format() == QImage::Format_Alpha8 ? CV_8UC1 : CV_8UC4,
+                    baseline.bits(),
+                    baseline.bytesPerLine());
+        cv::stackBlur(mat, mat, {kernelSize.width(), kernelSize.height()});
+        QCOMPARE(actual, baseline);
+    }
+#endif
+}
+
+// The matrix of benchmarkStackBlur(). Rows are named backend/format/image size/kernel size, so
+// the results of `-o results.csv,csv` or `-o results.xml,junitxml` can be tracked over time.
+// Images larger than 1024x1024 take too long for CI, set STACKBLURTEST_FULL_MATRIX=1 to include them.
+void StackBlurTest::benchmarkStackBlur_data()
+{
+    QTest::addColumn<int>("backend");
+    QTest::addColumn<int>("format");
+    QTest::addColumn<QSize>("imageSize");
+    QTest::addColumn<QSize>("kernelSize");
+
+    const QList<std::pair<const char *, QImage::Format>> formats{
+        {"RGBA8888_Premultiplied", QImage::Format_RGBA8888_Premultiplied},
+        {"ARGB32", QImage::Format_ARGB32},
+        {"RGB32", QImage::Format_RGB32},
+        {"Alpha8", QImage::Format_Alpha8},
+        {"RGBA64_Premultiplied", QImage::Format_RGBA64_Premultiplied},
+        {"RGBA16FPx4_Premultiplied", QImage::Format_RGBA16FPx4_Premultiplied},
+        {"RGBA32FPx4_Premultiplied", QImage::Format_RGBA32FPx4_Premultiplied},
+    };
+    QList<QSize> imageSizes{{64, 64}, {256, 256}, {1024, 1024}};
+    if (qEnvironmentVariableIntValue("STACKBLURTEST_FULL_MATRIX")) {
+        imageSizes << QSize{1920, 1080} << QSize{3840, 2160} << QSize{7680, 4320};
+    }
+    const QList<QSize> kernelSizes{{3, 3}, {15, 15}, {61, 61}, {121, 121}, {361, 361}, {61, 3}, {3, 61}, {361, 15}};
+    auto backends = StackBlur::availableBackends();
+    backends.prepend(StackBlur::Backend::Auto);
+    for (auto backend : backends) {
+        for (const auto &[formatName, format] : formats) {
+            for (const auto &imageSize : imageSizes) {
+                for (const auto &kernelSize : kernelSizes) {
+                    QTest::addRow("%s/%s/%dx%d/%dx%d",
+                                  StackBlur::backendName(backend),
+                                  formatName,
+                                  imageSize.width(),
+                                  imageSize.height(),
+                                  kernelSize.width(),
+                                  kernelSize.height())
+                        << int(backend) << int(format) << imageSize << kernelSize;
+                }
+            }
+        }
+    }
+}
+
+// A pixel as premultiplied RGBA between 0 and 1, whatever the format of the image.
+static std::array<double, 4> premultipliedPixel(const QImage &image, const QPoint &pos)
+{
+    const auto pixel = image.copy(QRect{pos, QSize{1, 1}}).convertToFormat(QImage::Format_RGBA32FPx4_Premultiplied);
+    auto values = reinterpret_cast<const float *>(pixel.constBits());
+    return {values[0], values[1], values[2], values[3]};
+}
+
+// A pixel of the blurred image, computed directly from the weights of the stack blur
+// without rounding, as premultiplied RGBA between 0 and 1.
+static std::array<double, 4> referencePixel(const QImage &source, const QPoint &pos, const QSize &kernelSize)
+{
+    const int radiusX = kernelRadius(kernelSize.width());
+    const int radiusY = kernelRadius(kernelSize.height());
+    const QRect patch = StackBlur::sourceRect(QRect{pos, QSize{1, 1}}, kernelSize).intersected(source.rect());
+    const auto pixels = source.copy(patch).convertToFormat(QImage::Format_RGBA32FPx4_Premultiplied);
+    std::array<double, 4> sum{};
+    for (int j = -radiusY; j <= radiusY; ++j) {
+        const int y = std::clamp(pos.y() + j, 0, source.height() - 1) - patch.top();
+        const double weightY = radiusY + 1 - std::abs(j);
+        auto line = reinterpret_cast<const float *>(pixels.constScanLine(y));
+        for (int i = -radiusX; i <= radiusX; ++i) {
+            const int x = std::clamp(pos.x() + i, 0, source.width() - 1) - patch.left();
+            const double weight = weightY * (radiusX + 1 - std::abs(i));
+            for (int c = 0; c < 4; ++c) {
+                sum[c] += line[x * 4 + c] * weight;
+            }
+        }
+    }
+    const double divisor = double(radiusX + 1) * (radiusX + 1) * (radiusY + 1) * (radiusY + 1);
+    for (auto &value : sum) {
+        value /= divisor;
+    }
+    return sum;
+}
+
 void StackBlurTest::benchmarkStackBlur()
 {
+    QFETCH(int, backend);
+    QFETCH(int, format);
+    QFETCH(QSize, imageSize);
+    QFETCH(QSize, kernelSize);
+
+    // Rows with the same image are next to each other, so they can share the noise.
+    static QImage noise;
+    if (noise.size() != imageSize || noise.format() != format) {
+        noise = colorNoiseImage(imageSize, QImage::Format(format));
+    }
+    auto image = noise;
+
+    // Check a few pixels against the reference first, so a fast but wrong backend doesn't go unnoticed.
+    // The kernels round in between the passes and the 8-bit kernels approximate the division.
+    // Radii above 254 scale the image, which moves some of the weight of the clamped edge pixels
+    // to their neighbours.
+    const bool scaled = kernelRadius(kernelSize.width()) > 254 || kernelRadius(kernelSize.height()) > 254;
+    const double tolerance = scaled ? 0.125 : 3 / 255.0;
+    auto blurred = image;
+    StackBlur::parallelBlur(blurred, blurred.rect(), kernelSize, StackBlur::Backend(backend), StackBlur::threadScratch());
+    QList<QPoint> samples{{0, 0}, {imageSize.width() - 1, imageSize.height() - 1}, {imageSize.width() / 2, imageSize.height() / 2}};
+    QRandomGenerator random(imageSize.width());
+    for (int i = 0; i < 8; ++i) {
+        samples.append({random.bounded(imageSize.width()), random.bounded(imageSize.height())});
+    }
+    for (const auto &pos : samples) {
+        const auto expected = referencePixel(image, pos, kernelSize);
+        const auto actual = premultipliedPixel(blurred, pos);
+        for (int c = 0; c < 4; ++c) {
+            QVERIFY2(std::abs(actual[c] - expected[c]) <= tolerance,
+                     qPrintable(u"Pixel %1,%2 channel %3 is %4 instead of %5"_s.arg(pos.x()).arg(pos.y()).arg(c).arg(actual[c]).arg(expected[c])));
+        }
+    }
+
+    QBENCHMARK {
+        StackBlur::parallelBlur(image, image.rect(), kernelSize, StackBlur::Backend(backend), StackBlur::threadScratch());
+    }
+}
+
+void StackBlurTest::benchmarkImplementations_data()
+{
+    QTest::addColumn<int>("impl");
+    QTest::newRow("default") << defaultImpl;
+    QTest::newRow("parallel") << parallelImpl;
+    QTest::newRow("reference") << referenceImpl;
+    for (const auto &[name, impl] : supportedImpls()) {
+        QTest::newRow(qPrintable(name)) << impl;
+    }
+}
+
+void StackBlurTest::benchmarkImplementations()
+{
+    QFETCH(int, impl);
+
     QImage img(QSize{1000, 1000}, QImage::Format_RGBA8888_Premultiplied);
+    img.fill(Qt::transparent);
     QPainter qPainter(&img);
     qPainter.setBrush(Qt::NoBrush);
     for (auto x = 0; x < 20; x++) {
@@ -25,15 +742,47 @@ void StackBlurTest::benchmarkStackBlur()
             qPainter.drawRect(x * 50, y * 50, 50, 50);
         }
     }
+    qPainter.end();
 
     QVERIFY(!img.isNull());
 
     QBENCHMARK {
-        StackBlur::blur(img, {121, 121});
+        blurWith(impl, img, {121, 121});
         QVERIFY(!img.isNull());
     }
 }
 
+void StackBlurTest::benchmarkPasses_data()
+{
+    QTest::addColumn<int>("impl");
+    QTest::addColumn<QSize>("kernelSize");
+    for (const auto &[name, impl] : supportedImpls()) {
+        QTest::addRow("%s-horizontal", qPrintable(name)) << impl << QSize(60, 0);
+        QTest::addRow("%s-vertical", qPrintable(name)) << impl << QSize(0, 60);
+    }
+}
+
+void StackBlurTest::benchmarkPasses()
+{
+    QFETCH(int, impl);
+    QFETCH(QSize, kernelSize);
+
+    // Wide enough that every row is on a different page, where the vertical pass used to fall behind.
+    auto image = noiseImage({4000, 3000}, QImage::Format_RGBA8888_Premultiplied);
+    QBENCHMARK {
+        StackBlur::blur(image, kernelSize, StackBlur::Simd(impl));
+    }
+}
+
+void StackBlurTest::benchmarkRoi()
+{
+    // A small redaction box on a large screenshot.
+    auto image = noiseImage({7680, 4320}, QImage::Format_RGBA8888_Premultiplied);
+    QBENCHMARK {
+        StackBlur::blur(image, QRect{3000, 2000, 200, 100}, {121, 121});
+    }
+}
+
 QTEST_GUILESS_MAIN(StackBlurTest)
 
 #include "stackblurtest.moc"
@@ -0,0 +1,120 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "../src/annotations/tiledlayer.h"
+
+#include <QImage>
+#include <QObject>
+#include <QPainter>
+#include <QTest>
+
+class TiledLayerTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testRepaint();
+    void testChangedSince();
+    void testThreads();
+};
+
+static QImage transparentImage(const QSize &size, qreal dpr)
+{
+    QImage image(size, QImage::Format_RGBA8888_Premultiplied);
+    image.setDevicePixelRatio(dpr);
+    image.fill(Qt::transparent);
+    return image;
+}
+
+void TiledLayerTest::testRepaint()
+{
+    TiledLayer layer;
+    layer.reset(transparentImage({600, 300}, 2));
+    QCOMPARE(layer.tiles().size(), qsizetype(3 * 2));
+    // Tiles at the edges are cut to the image.
+    QCOMPARE(layer.tiles().last().rect, QRect(512, 256, 88, 44));
+    QVERIFY(layer.isDirty());
+
+    // Painted in the device independent coordinates of the whole image.
+    const QRectF red{100, 50, 100, 50};
+    QList<QRect> painted;
+    auto paint = [&](QPainter *painter, const QRect &tileRect) {
+        painted.append(tileRect);
+        painter->fillRect(red, Qt::red);
+    };
+    layer.repaint(paint);
+    QCOMPARE(painted.size(), qsizetype(6));
+    QVERIFY(!layer.isDirty());
+
+    auto expected = transparentImage({600, 300}, 2);
+    QPainter painter(&expected);
+    painter.fillRect(red, Qt::red);
+    painter.end();
+    QCOMPARE(layer.image(), expected);
+
+    // Only the tiles touching the rect are repainted.
+    painted.clear();
+    layer.markDirty({250, 10, 10, 10});
+    layer.repaint(paint);
+    QCOMPARE(painted, (QList<QRect>{{0, 0, 256, 256}, {256, 0, 256, 256}}));
+    QCOMPARE(layer.image(), expected);
+
+    // Nothing to repaint.
+    painted.clear();
+    const auto version = layer.version();
+    layer.markDirty({1000, 1000, 10, 10});
+    layer.repaint(paint);
+    QVERIFY(painted.isEmpty());
+    QCOMPARE(layer.version(), version);
+}
+
+void TiledLayerTest::testChangedSince()
+{
+    TiledLayer layer;
+    const auto beforeReset = layer.version();
+    layer.reset(transparentImage({600, 300}, 1));
+    auto paint = [](QPainter *, const QRect &) { };
+    layer.repaint(paint);
+    QCOMPARE(layer.changedSince(beforeReset), QRegion(0, 0, 600, 300));
+
+    const auto painted = layer.version();
+    QVERIFY(layer.changedSince(painted).isEmpty());
+    layer.markDirty({300, 260, 1, 1});
+    layer.repaint(paint);
+    QCOMPARE(layer.changedSince(painted), QRegion(256, 256, 256, 44));
+
+    const auto first = layer.version();
+    layer.markDirty({0, 0, 1, 1});
+    layer.repaint(paint);
+    QCOMPARE(layer.changedSince(first), QRegion(0, 0, 256, 256));
+    QCOMPARE(layer.changedSince(painted), QRegion(0, 0, 256, 256) + QRegion(256, 256, 256, 44));
+
+    // Everything changed since before the last reset.
+    layer.reset(transparentImage({100, 100}, 1));
+    QCOMPARE(layer.changedSince(first), QRegion(0, 0, 100, 100));
+}
+
+// The same image on any number of threads.
+void TiledLayerTest::testThreads()
+{
+    auto paint = [](QPainter *painter, const QRect &) {
+        painter->setRenderHint(QPainter::Antialiasing);
+        painter->setPen(QPen(Qt::blue, 7));
+        painter->setBrush(QColor(255, 0, 0, 128));
+        for (int i = 0; i < 20; ++i) {
+            painter->drawEllipse(QRectF(i * 37.5, i * 21.25, 300, 200));
+        }
+    };
+    TiledLayer inOrder;
+    inOrder.reset(transparentImage({1000, 700}, 1.5));
+    inOrder.repaint(paint, 1);
+
+    TiledLayer threaded;
+    threaded.reset(transparentImage({1000, 700}, 1.5));
+    threaded.repaint(paint, 4);
+    QCOMPARE(threaded.image(), inOrder.image());
+    QVERIFY(!threaded.isDirty());
+}
+
+QTEST_GUILESS_MAIN(TiledLayerTest)
+
+#include "tiledlayertest.moc"
@@ -5,20 +5,28 @@
  */
 
 #include "annotationdocument_p.h"
+#include "pathsimplification.h"
 #include "utils.h"
 
 #include <QGuiApplication>
 #include <QImageReader>
+#include <QLoggingCategory>
 #include <QPainter>
 #include <QPainterPath>
 #include <QQuickItem>
 #include <QQuickWindow>
+#include <QScopeGuard>
 #include <QScreen>
 #include <memory>
 #include <source_location>
 
 using namespace Qt::StringLiterals;
 
+Q_LOGGING_CATEGORY(KQIE_ANNOTATIONS, "org.kde.kquickimageeditor.annotations", QtInfoMsg)
+
+// How far simplified freehand paths can be from the points drawn, in image pixels.
+static constexpr qreal freehandTolerance = 0.5;
+
 QImage defaultImage(const QSize &size, qreal dpr)
 {
     // RGBA is better for use with stackblur
@@ -39,6 +47,18 @@ AnnotationDocument::AnnotationDocument(QObject *parent)
     : QObject(parent)
     , d(std::make_unique<AnnotationDocumentPrivate>(this))
 {
+    connect(&d->effectJobs, &EffectJobs::finished, this, [this](const EffectCache::Key &key, const QImage &image) {
+        d->effectCache.insert(key, image);
+        // Only repaint where the image goes.
+        d->setRepaintRegion(Utils::rectScaled(key.rect, 1 / key.dpr));
+    });
+    // Items only leave the history when the undo or redo list changes.
+    connect(this, &AnnotationDocument::undoStackDepthChanged, this, [this] {
+        d->dropRemovedShadows();
+    });
+    connect(this, &AnnotationDocument::redoStackDepthChanged, this, [this] {
+        d->dropRemovedShadows();
+    });
 }
 
 AnnotationDocument::~AnnotationDocument() = default;
@@ -140,8 +160,7 @@ void AnnotationDocumentPrivate::setCanvas(const QRectF &rect, qreal dpr, const s
         }
         return image.transformed(transform.toTransform(), Qt::SmoothTransformation);
     }();
-    annotationsImage = defaultImage(imageSize, imageDpr);
-    annotationsImage = q->annotationsImage();
+    annotationsLayer.reset(defaultImage(imageSize, imageDpr));
     // Unconditionally repaint the whole canvas area
     setRepaintRegion();
 }
@@ -175,6 +194,10 @@ void AnnotationDocument::setBaseImage(const QImage &image)
         return;
     }
     d->baseImage = image;
+    // Effect results and checkpoints for the old image can't be used anymore.
+    d->effectCache.clear();
+    d->shadowSlots.clear();
+    d->checkpoints.clear();
     d->setCanvas(deviceIndependentRect(d->baseImage), d->baseImage.devicePixelRatio(), QTransform{});
 }
 
@@ -190,6 +213,31 @@ void AnnotationDocument::setBaseImage(const QUrl &localFile)
     setBaseImage(localFile.toLocalFile());
 }
 
+qsizetype AnnotationDocument::effectCacheBudget() const
+{
+    return d->effectCache.byteBudget();
+}
+
+void AnnotationDocument::setEffectCacheBudget(qsizetype bytes)
+{
+    d->effectCache.setByteBudget(bytes);
+}
+
+qint64 AnnotationDocument::effectCacheHits() const
+{
+    return d->effectCache.stats().hits;
+}
+
+qint64 AnnotationDocument::effectCacheMisses() const
+{
+    return d->effectCache.stats().misses;
+}
+
+qsizetype AnnotationDocument::effectCacheBytes() const
+{
+    return d->effectCache.stats().bytes;
+}
+
 void AnnotationDocument::cropCanvas(const QRectF &cropRect)
 {
     // Can't crop to nothing
@@ -314,6 +362,61 @@ void AnnotationDocumentPrivate::paintImageView(QPainter *painter, const QImage &
     }
 }
 
+template<typename Effect>
+void AnnotationDocumentPrivate::paintEffect(QPainter *painter, const Effect &effect, const QRectF &rect, History::SubRange untilNow, const EffectJobs::Slot &slot, bool async) const
+{
+    QMutexLocker locker(&effectsMutex);
+    // Pixelated blocks should stay sharp when scaled.
+    constexpr bool smooth = !std::is_same_v<Effect, Traits::ImageEffects::Pixelate>;
+    auto getImage = [this, untilNow] {
+        return rangeImage(untilNow);
+    };
+    // Only what the effect reads, so painting doesn't wait for the whole image to be composited.
+    auto getSourceImage = [this, untilNow, &effect, &rect] {
+        return rangeImage(untilNow, effect.sourcePixels(rect, imageDpr));
+    };
+    const auto sources = effectSources(untilNow, effect.sourceRect(rect, imageDpr));
+    QImage image;
+    if (!async) {
+        image = effect.image(getImage, rect, imageDpr, sources, &effectCache);
+    } else {
+        using Traits::ImageEffects::Quality;
+        const auto key = effect.key(rect, imageDpr, sources);
+        image = effectCache.find(key);
+        if (image.isNull() && interactiveEffects) {
+            // Quick enough to make again for every change while the pointer moves.
+            // The full quality image is made once the interaction ends.
+            image = effect.image(getSourceImage, rect, imageDpr, sources, &effectCache, Quality::Interactive);
+            interactiveRegion += rect.toAlignedRect();
+        }
+        const auto lastResult = effectJobs.lastResult(slot);
+        // The image can't always be cached, but the last one made is kept anyway.
+        if (image.isNull() && lastResult.key != key) {
+            if (!effectJobs.isPending(key)) {
+                effectJobs.start(slot, key, [effect, source = getSourceImage(), rect, dpr = imageDpr] {
+                    return effect.apply(source, rect, dpr);
+                });
+            }
+            // Shown while waiting, since it is made from the same sources for the same rect.
+            image = effectCache.find(effect.key(rect, imageDpr, sources, Quality::Interactive));
+            if (image.isNull() && lastResult.image.isNull()) {
+                // Opaque, so nothing that should be hidden shows through while waiting.
+                painter->fillRect(rect, QColor(128, 128, 128));
+                return;
+            }
+        }
+        if (image.isNull()) {
+            // Either the exact image or a placeholder scaled from an earlier rect.
+            image = lastResult.image;
+        }
+    }
+    if (image.isNull()) {
+        return;
+    }
+    painter->setRenderHint(QPainter::SmoothPixmapTransform, smooth);
+    painter->drawImage(rect, image);
+}
+
 void AnnotationDocumentPrivate::paintAnnotations(QPainter *painter, const QRegion &region, std::optional<History::SubRange> range) const
 {
     if (!painter || region.isEmpty()) {
@@ -323,14 +426,37 @@ void AnnotationDocumentPrivate::paintAnnotations(QPainter *painter, const QRegio
     if (undoList.empty() || (range && range->empty())) {
         return;
     }
+    // Images under other effects and in checkpoints can't have placeholders,
+    // so only effects painted over the whole history can be made asynchronously.
+    const bool asyncEffects = !range && !synchronousEffects;
+    // Images of a range are painted over the base image or a checkpoint made from it.
+    const bool overBaseImage = range.has_value();
     if (!range) {
         range.emplace(undoList);
     }
 
     const auto begin = range->begin();
     const auto end = range->end();
+    // The visible items that can intersect the region, by their index in the undo list.
+    const qsizetype first = begin - undoList.begin();
+    const qsizetype last = end - undoList.begin();
+    auto indexes = history.visibleIndex().intersecting(region.boundingRect());
+    std::erase_if(indexes, [first, last](qsizetype index) {
+        return index < first || index >= last;
+    });
+    // The selected item is painted as the temporary item, which can be somewhere else.
+    if (const auto selectedItem = selectedItemWrapper->d->selectedItem.lock(); tempItem && history.itemVisible(selectedItem)) {
+        const auto index = history.indexOf(selectedItem);
+        if (index >= first && index < last) {
+            if (const auto pos = std::ranges::lower_bound(indexes, index); pos == indexes.end() || *pos != index) {
+                indexes.insert(pos, index);
+            }
+        }
+    }
     // Only highlighter needs the base image to be rendered underneath itself to function correctly.
-    const bool hasHighlighter = std::any_of(begin, end, [this, &region](const HistoryItem::const_shared_ptr &item) {
+    // It's already there when painting over the base image.
+    const bool hasHighlighter = !overBaseImage && std::ranges::any_of(indexes, [this, &region, &undoList](qsizetype index) {
+        const auto &item = undoList[index];
         const auto &renderedItem = item == selectedItemWrapper->d->selectedItem ? tempItem : item;
         if (!renderedItem) {
             return false;
@@ -340,7 +466,7 @@ void AnnotationDocumentPrivate::paintAnnotations(QPainter *painter, const QRegio
             return false;
         }
         return std::get<Traits::Highlight::Opt>(renderedItem->traits()).has_value() //
-            && history.itemVisible(item) && region.intersects(visual->rect.toAlignedRect());
+            && region.intersects(visual->rect.toAlignedRect());
     });
     if (hasHighlighter) {
         bool hasDifferentClip = false;
@@ -353,18 +479,17 @@ void AnnotationDocumentPrivate::paintAnnotations(QPainter *painter, const QRegio
             }
         }
         auto transform = painter->transform();
-        painter->setTransform({});
+        // Without the render transform, which leaves the offset of the tile being painted.
+        painter->setTransform(renderTransform.toTransform().inverted() * transform);
         paintImageView(painter, q->canvasBaseImage());
         painter->setTransform(transform);
         if (hasDifferentClip) {
             painter->setClipRegion(oldRegion);
         }
     }
-    for (auto it = begin; it != end; ++it) {
+    for (const auto index : std::as_const(indexes)) {
+        const auto it = undoList.begin() + index;
         const auto item = *it;
-        if (!history.itemVisible(item)) {
-            continue;
-        }
         // Render the temporary item instead if this item is selected.
         const auto isSelected = item == selectedItemWrapper->d->selectedItem;
         const auto &renderedItem = isSelected ? tempItem : item;
@@ -386,7 +511,7 @@ void AnnotationDocumentPrivate::paintAnnotations(QPainter *painter, const QRegio
         // Draw the shadow if existent
         auto &shadow = std::get<Traits::Shadow::Opt>(renderedItem->traits());
         if (shadow && shadow->enabled) {
-            QImage image = Utils::shapeShadow(renderedItem->traits());
+            QImage image = shadowImage(item, *renderedItem);
             painter->setRenderHint(QPainter::SmoothPixmapTransform, true);
             painter->drawImage(visual->rect, image);
         }
@@ -401,26 +526,14 @@ void AnnotationDocumentPrivate::paintAnnotations(QPainter *painter, const QRegio
                 painter->drawPath(geometry->path);
                 break;
             case Traits::Fill::Blur: {
-                auto &blur = std::get<Fill::Blur>(fill);
-                auto untilNow = History::SubRange{begin, it};
-                auto getImage = [this, untilNow] {
-                    return rangeImage(untilNow);
-                };
+                auto untilNow = History::SubRange{undoList.begin(), it};
                 const auto &rect = geometry->path.boundingRect();
-                const auto &image = blur.image(getImage, rect, imageDpr);
-                painter->setRenderHint(QPainter::SmoothPixmapTransform, true);
-                painter->drawImage(rect, image);
+                paintEffect(painter, std::get<Fill::Blur>(fill), rect, untilNow, item, asyncEffects);
             } break;
             case Traits::Fill::Pixelate: {
-                auto &pixelate = std::get<Fill::Pixelate>(fill);
-                auto untilNow = History::SubRange{begin, it};
-                auto getImage = [this, untilNow] {
-                    return rangeImage(untilNow);
-                };
+                auto untilNow = History::SubRange{undoList.begin(), it};
                 const auto &rect = geometry->path.boundingRect();
-                const auto &image = pixelate.image(getImage, rect, imageDpr);
-                painter->setRenderHint(QPainter::SmoothPixmapTransform, false);
-                painter->drawImage(rect, image);
+                paintEffect(painter, std::get<Fill::Pixelate>(fill), rect, untilNow, item, asyncEffects);
             } break;
             default:
                 break;
@@ -443,29 +556,60 @@ void AnnotationDocumentPrivate::paintAnnotations(QPainter *painter, const QRegio
 
 QImage AnnotationDocument::annotationsImage() const
 {
-    if (d->annotationsImage.isNull()) {
+    if (d->annotationsLayer.isNull()) {
         return {};
     }
     if (!d->repaintRegion.isEmpty()) {
-        QPainter painter(&d->annotationsImage);
-        painter.setTransform(d->renderTransform.toTransform());
-        // Set clip region to prevent over-painting shadows or semi-transparent annotations near the region.
-        painter.setClipRegion(d->repaintRegion);
-        // Clear mode is needed to actually clear the region.
-        painter.setCompositionMode(QPainter::CompositionMode_Clear);
-        // The painter is clipped to the region, so we can just use eraseRect.
-        painter.eraseRect(d->repaintRegion.boundingRect());
-        // Restore default composition mode.
-        painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
-        d->paintAnnotations(&painter, d->repaintRegion);
-        painter.end();
+        const auto renderTransform = d->renderTransform.toTransform();
+        const auto invertedRenderTransform = renderTransform.inverted();
+        d->annotationsLayer.repaint([&](QPainter *painter, const QRect &tileRect) {
+            painter->setTransform(renderTransform, true);
+            // Only the part of the region inside the tile.
+            const auto tileDocumentRect = invertedRenderTransform.mapRect(Utils::rectScaled(QRectF(tileRect), 1 / d->imageDpr));
+            const auto region = d->repaintRegion.intersected(tileDocumentRect.toAlignedRect());
+            // Set clip region to prevent over-painting shadows or semi-transparent annotations near the region.
+            painter->setClipRegion(region);
+            // Clear mode is needed to actually clear the region.
+            painter->setCompositionMode(QPainter::CompositionMode_Clear);
+            // The painter is clipped to the region, so we can just use eraseRect.
+            painter->eraseRect(region.boundingRect());
+            // Restore default composition mode.
+            painter->setCompositionMode(QPainter::CompositionMode_SourceOver);
+            d->paintAnnotations(painter, region);
+        }, d->maxRenderThreads);
         d->repaintRegion = {};
     }
-    return d->annotationsImage;
+    return d->annotationsLayer.image();
+}
+
+quint64 AnnotationDocument::annotationsVersion() const
+{
+    return d->annotationsLayer.version();
+}
+
+QRegion AnnotationDocument::annotationsChangedSince(quint64 version) const
+{
+    return d->annotationsLayer.changedSince(version);
+}
+
+int AnnotationDocument::maxRenderThreads() const
+{
+    return d->maxRenderThreads;
+}
+
+void AnnotationDocument::setMaxRenderThreads(int threads)
+{
+    d->maxRenderThreads = std::max(threads, 0);
 }
 
 QImage AnnotationDocument::renderToImage() const
 {
+    // Finished jobs mark their rects for repainting, which replaces their placeholders.
+    d->effectJobs.waitForDone();
+    d->synchronousEffects = true;
+    auto restoreAsync = qScopeGuard([this] {
+        d->synchronousEffects = false;
+    });
     auto image = canvasBaseImage();
     QPainter painter(&image);
     d->paintImageView(&painter, annotationsImage());
@@ -478,12 +622,179 @@ bool AnnotationDocument::saveImage(const QString &path) const
     return renderToImage().save(path);
 }
 
+QImage AnnotationDocumentPrivate::shadowImage(const HistoryItem::const_shared_ptr &item, const HistoryItem &renderedItem) const
+{
+    // Shared with image effects, which can be painted on other threads.
+    QMutexLocker locker(&effectsMutex);
+    const auto &visual = std::get<Traits::Visual::Opt>(renderedItem.traits());
+    // The revision changes with the geometry, stroke, fill and text.
+    // Shadows are soft enough to be made at a DPR of 1 and scaled.
+    const EffectCache::Key key{shadowEffect, {0, {renderedItem.revision()}}, visual->rect.toAlignedRect(), 0, 1};
+    auto image = effectCache.find(key);
+    if (image.isNull()) {
+        image = Utils::shapeShadow(renderedItem.traits());
+        effectCache.insert(key, image);
+    }
+    auto &slotKey = shadowSlots[item];
+    if (slotKey != key) {
+        // The item changed, so the earlier shadow won't be painted again.
+        effectCache.remove(slotKey);
+        slotKey = key;
+    }
+    return image;
+}
+
+void AnnotationDocumentPrivate::dropRemovedShadows()
+{
+    QMutexLocker locker(&effectsMutex);
+    const auto &redoList = history.redoList();
+    for (auto it = shadowSlots.begin(); it != shadowSlots.end();) {
+        const auto item = it->first.lock();
+        if (item && (history.indexOf(item) >= 0 || std::ranges::find(redoList, item) != redoList.end())) {
+            ++it;
+            continue;
+        }
+        effectCache.remove(it->second);
+        it = shadowSlots.erase(it);
+    }
+}
+
+// The section of the document that an image effect item is made from.
+// Empty if the item has no image effect.
+static QRectF effectSourceRect(const Traits::OptTuple &traits, qreal dpr)
+{
+    auto &geometry = std::get<Traits::Geometry::Opt>(traits);
+    auto &fill = std::get<Traits::Fill::Opt>(traits);
+    if (!geometry || !fill) {
+        return {};
+    }
+    const auto &rect = geometry->path.boundingRect();
+    if (auto blur = std::get_if<Traits::Fill::Blur>(&fill.value())) {
+        return blur->sourceRect(rect, dpr);
+    } else if (auto pixelate = std::get_if<Traits::Fill::Pixelate>(&fill.value())) {
+        return pixelate->sourceRect(rect, dpr);
+    }
+    return {};
+}
+
+Traits::ImageEffects::Sources AnnotationDocumentPrivate::effectSources(History::SubRange range, QRectF rect) const
+{
+    Traits::ImageEffects::Sources sources{baseImage.cacheKey(), {}};
+    // Going from the top down, the image effects found under the rect extend it by their own source
+    // rect, since the items under those can change them. Items above can't change anything below.
+    for (auto it = range.end(); it != range.begin();) {
+        const auto item = *--it;
+        if (!history.itemVisible(item)) {
+            continue;
+        }
+        const auto &renderedItem = item == selectedItemWrapper->d->selectedItem ? tempItem : item;
+        if (!renderedItem) {
+            continue;
+        }
+        auto &visual = std::get<Traits::Visual::Opt>(renderedItem->traits());
+        if (!visual || !visual->rect.intersects(rect)) {
+            continue;
+        }
+        sources.revisions.append(renderedItem->revision());
+        rect |= effectSourceRect(renderedItem->traits(), imageDpr);
+    }
+    return sources;
+}
+
+const CompositeCheckpoints::Checkpoint *AnnotationDocumentPrivate::rangeCheckpoint(History::SubRange range, Traits::ImageEffects::Sources &sources) const
+{
+    const auto &undoList = history.undoList();
+    const auto begin = undoList.begin();
+    const auto end = range.end();
+    // What the image is made from and the positions of the items painted in it.
+    sources = {baseImage.cacheKey(), {}};
+    QList<qsizetype> positions;
+    for (auto it = begin; it != end; ++it) {
+        const auto &item = *it;
+        const auto &renderedItem = item == selectedItemWrapper->d->selectedItem ? tempItem : item;
+        if (renderedItem && history.itemVisible(item)) {
+            sources.revisions.append(renderedItem->revision());
+            positions.append(std::distance(begin, it));
+        }
+    }
+
+    // A checkpoint is still valid if the items before its position are the same as when it was made.
+    return checkpoints.find(std::distance(begin, end), [&](const CompositeCheckpoints::Checkpoint &checkpoint) {
+        const auto count = std::lower_bound(positions.cbegin(), positions.cend(), checkpoint.position) - positions.cbegin();
+        return checkpoint.sources.imageKey == sources.imageKey && checkpoint.sources.revisions == sources.revisions.first(count);
+    });
+}
+
 QImage AnnotationDocumentPrivate::rangeImage(History::SubRange range) const
 {
     auto image = baseImage;
+    if (!CompositeCheckpoints::supports(image)) {
+        QPainter p(&image);
+        paintAnnotations(&p, deviceIndependentRect(image).toAlignedRect(), range);
+        p.end();
+        return image;
+    }
+
+    const auto begin = history.undoList().begin();
+    const auto end = range.end();
+    const qsizetype position = std::distance(begin, end);
+    Traits::ImageEffects::Sources sources;
+    const auto checkpoint = rangeCheckpoint(range, sources);
+    qsizetype start = 0;
+    QHash<QPoint, QImage> tiles;
+    if (checkpoint) {
+        CompositeCheckpoints::restore(image, *checkpoint);
+        start = checkpoint->position;
+        tiles = checkpoint->tiles;
+    }
+    if (start == position) {
+        return image;
+    }
+
     QPainter p(&image);
-    paintAnnotations(&p, deviceIndependentRect(image).toAlignedRect(), range);
+    paintAnnotations(&p, deviceIndependentRect(image).toAlignedRect(), History::SubRange{begin + start, end});
     p.end();
+
+    QRegion changed;
+    for (auto it = begin + start; it != end; ++it) {
+        const auto &item = *it;
+        const auto &renderedItem = item == selectedItemWrapper->d->selectedItem ? tempItem : item;
+        if (!renderedItem || !history.itemVisible(item)) {
+            continue;
+        }
+        if (auto &visual = std::get<Traits::Visual::Opt>(renderedItem->traits())) {
+            // Antialiasing can touch the pixels just outside of the rect.
+            changed += Utils::rectScaled(visual->rect, image.devicePixelRatio()).toAlignedRect().adjusted(-1, -1, 1, 1);
+        }
+    }
+    checkpoints.insert({position, std::move(sources), CompositeCheckpoints::updatedTiles(image, changed, std::move(tiles))});
+    return image;
+}
+
+QImage AnnotationDocumentPrivate::rangeImage(History::SubRange range, const QRect &pixels) const
+{
+    const QRect rect = pixels.intersected(baseImage.rect());
+    if (rect.isEmpty()) {
+        return {};
+    }
+    auto image = baseImage.copy(rect);
+    const auto begin = history.undoList().begin();
+    qsizetype start = 0;
+    if (CompositeCheckpoints::supports(image)) {
+        Traits::ImageEffects::Sources sources;
+        if (const auto checkpoint = rangeCheckpoint(range, sources)) {
+            CompositeCheckpoints::restore(image, *checkpoint, rect.topLeft());
+            start = checkpoint->position;
+        }
+    }
+    if (begin + start != range.end()) {
+        const auto dpr = image.devicePixelRatio();
+        QPainter p(&image);
+        p.translate(-QPointF(rect.topLeft()) / dpr);
+        paintAnnotations(&p, Utils::rectScaled(QRectF(rect), 1 / dpr).toAlignedRect(), History::SubRange{begin + start, range.end()});
+        p.end();
+    }
+    image.setOffset(rect.topLeft());
     return image;
 }
 
@@ -515,14 +826,14 @@ HistoryItem::shared_ptr AnnotationDocumentPrivate::popCurrentItem()
 HistoryItem::const_shared_ptr AnnotationDocumentPrivate::itemAt(const QRectF &rect) const
 {
     const auto &undoList = history.undoList();
+    const auto &visibleIndex = history.visibleIndex();
     // Precisely the first time so that users can get exactly what they click.
-    for (auto it = std::ranges::crbegin(undoList); it != std::ranges::crend(undoList); ++it) {
-        const auto item = *it;
-        if (history.itemVisible(item)) {
-            auto &interactive = std::get<Traits::Interactive::Opt>(item->traits());
-            if (interactive->path.contains(rect.center())) {
-                return item;
-            }
+    // The topmost items are last.
+    const auto containing = visibleIndex.containing(rect.center());
+    for (auto it = containing.crbegin(); it != containing.crend(); ++it) {
+        const auto item = undoList[*it];
+        if (Traits::hitShape(item->traits()).contains(rect.center())) {
+            return item;
         }
     }
     // If rect has no width or height
@@ -530,15 +841,13 @@ HistoryItem::const_shared_ptr AnnotationDocumentPrivate::itemAt(const QRectF &re
         return nullptr;
     }
     // Forgiving if that failed so that you don't need to be perfect.
-    for (auto it = std::ranges::crbegin(undoList); it != std::ranges::crend(undoList); ++it) {
-        const auto item = *it;
-        if (history.itemVisible(item)) {
-            QPainterPath path(rect.topLeft());
-            path.addEllipse(rect);
-            auto &interactive = std::get<Traits::Interactive::Opt>(item->traits());
-            if (interactive->path.intersects(path)) {
-                return item;
-            }
+    // The circle fitting in rect.
+    const auto radius = std::min(rect.width(), rect.height()) / 2;
+    const auto intersecting = visibleIndex.intersecting(rect);
+    for (auto it = intersecting.crbegin(); it != intersecting.crend(); ++it) {
+        const auto item = undoList[*it];
+        if (Traits::hitShape(item->traits()).contains(rect.center(), radius)) {
+            return item;
         }
     }
     return nullptr;
@@ -647,6 +956,7 @@ void AnnotationDocument::beginItem(const QPointF &point)
     if (!d->tool->isCreationTool()) {
         return;
     }
+    d->setInteractiveEffects(true);
 
     auto wasModified = d->history.isModified();
     // if the last item was not valid, discard it (for instance a rectangle with 0 size)
@@ -663,7 +973,7 @@ void AnnotationDocument::beginItem(const QPointF &point)
     auto &geometry = std::get<Traits::Geometry::Opt>(temp.traits());
     geometry.emplace(QPainterPath{point});
     auto &interactive = std::get<Traits::Interactive::Opt>(temp.traits());
-    interactive.emplace(QPainterPath{point});
+    interactive.emplace();
     auto &visual = std::get<Traits::Visual::Opt>(temp.traits());
     visual.emplace(QRectF{point, point});
 
@@ -730,6 +1040,8 @@ void AnnotationDocument::continueItem(const QPointF &point, ContinueOptions opti
     d->setRepaintRegion(item->renderRect());
     auto &geometry = std::get<Traits::Geometry::Opt>(item->traits());
     auto &path = geometry->path;
+    // The part added to the end of the path, when only that part needs to be stroked.
+    std::optional<QPainterPath> newSegment;
     const auto toolType = d->tool->type();
     switch (toolType) {
     case AnnotationTool::FreehandTool:
@@ -745,10 +1057,16 @@ void AnnotationDocument::continueItem(const QPointF &point, ContinueOptions opti
         } else {
             // smooth path as we go.
             path.quadTo(lastElement, (lastElement + point) / 2);
+            newSegment.emplace(lastElement);
+            newSegment->quadTo(lastElement, (lastElement + point) / 2);
         }
         if (auto &stroke = std::get<Traits::Stroke::Opt>(item->traits()); //
             stroke && toolType == AnnotationTool::HighlighterTool) {
             bool flatCap = options & ContinueOption::Snap && path.elementCount() == 2;
+            if (stroke->pen.capStyle() != (flatCap ? Qt::FlatCap : Qt::RoundCap)) {
+                // The caps already stroked would be wrong.
+                newSegment.reset();
+            }
             stroke->pen.setCapStyle(flatCap ? Qt::FlatCap : Qt::RoundCap);
         }
     } break;
@@ -839,19 +1157,29 @@ void AnnotationDocument::continueItem(const QPointF &point, ContinueOptions opti
         return;
     }
 
-    Traits::clearForInit(item->traits());
-    Traits::fastInitOptTuple(item->traits());
+    if (newSegment) {
+        // Stroking the whole path for every point would get slower the longer the path gets.
+        // finishItem() makes the whole stroke again.
+        Traits::extendStroke(item->traits(), *newSegment);
+    } else {
+        Traits::clearForInit(item->traits());
+        Traits::initOptTuple(item->traits());
+    }
+    item->updateRevision();
 
     if (isSelected) {
         *currentItem = *item;
         d->selectedItemWrapper->d->reset();
         d->selectedItemWrapper->d->setSelectedItem(currentItem);
     }
+    d->history.updateItem(currentItem);
     d->setRepaintRegion(item->renderRect());
 }
 
 void AnnotationDocument::finishItem()
 {
+    // Even when nothing was made, so an interaction can't be left unfinished.
+    d->setInteractiveEffects(false);
     const auto &currentItem = d->history.currentItem();
     bool isSelected = d->selectedItemWrapper->d->selectedItem == currentItem;
     const auto &item = isSelected ? d->tempItem : currentItem;
@@ -859,13 +1187,29 @@ void AnnotationDocument::finishItem()
         return;
     }
 
-    Traits::initOptTuple(item->traits());
+    // Simplifying changes the geometry and the stroke, so what was painted while drawing is replaced.
+    const auto oldRect = item->renderRect();
+    if (isAnyOfToolType(d->tool->type(), AnnotationTool::FreehandTool, AnnotationTool::HighlighterTool)) {
+        // Freehand paths have a segment for every mouse move.
+        auto &path = std::get<Traits::Geometry::Opt>(item->traits())->path;
+        const auto elementCount = path.elementCount();
+        path = PathSimplification::simplified(path, freehandTolerance / d->imageDpr);
+        qCDebug(KQIE_ANNOTATIONS) << "Simplified freehand path from" << elementCount << "to" << path.elementCount() << "elements";
+        // Replace the stroke extended one segment at a time by continueItem().
+        Traits::reInitTraits(item->traits());
+    } else {
+        Traits::initOptTuple(item->traits());
+    }
+    item->updateRevision();
+    // Also repaints the effects over the item, which are made from its new revision.
+    d->setRepaintRegion(oldRect | item->renderRect());
     if (isSelected) {
         *currentItem = *item;
         d->selectedItemWrapper->d->reset();
         d->selectedItemWrapper->d->setSelectedItem(currentItem);
         Q_EMIT selectedItemWrapperChanged(); // re-evaluate qml bindings
     }
+    d->history.updateItem(currentItem);
 }
 
 void AnnotationDocument::selectItem(const QRectF &rect)
@@ -875,6 +1219,7 @@ void AnnotationDocument::selectItem(const QRectF &rect)
 
 void AnnotationDocument::deselectItem()
 {
+    d->setInteractiveEffects(false);
     d->selectedItemWrapper->d->setSelectedItem(nullptr);
 }
 
@@ -893,6 +1238,18 @@ void AnnotationDocument::deleteSelectedItem()
     d->setRepaintRegion(selectedItem->renderRect());
 }
 
+void AnnotationDocumentPrivate::setInteractiveEffects(bool interactive)
+{
+    if (interactiveEffects == interactive) {
+        return;
+    }
+    interactiveEffects = interactive;
+    if (!interactive && !interactiveRegion.isEmpty()) {
+        setRepaintRegion(interactiveRegion.boundingRect());
+        interactiveRegion = {};
+    }
+}
+
 void AnnotationDocumentPrivate::addItem(const HistoryItem::shared_ptr &item)
 {
     auto wasModified = history.isModified();
@@ -932,6 +1289,7 @@ void AnnotationDocumentPrivate::setRepaintRegion(const QRectF &rect, AnnotationD
     }
     const bool emitRepaintNeeded = repaintRegion.isEmpty() || lastRepaintTypes != types;
     repaintRegion += biggerRect;
+    annotationsLayer.markDirty(Utils::rectScaled(renderTransform.mapRect(QRectF(biggerRect)), imageDpr).toAlignedRect());
     lastRepaintTypes = types;
     if (emitRepaintNeeded) {
         Q_EMIT q->repaintNeeded(lastRepaintTypes);
@@ -942,6 +1300,7 @@ void AnnotationDocumentPrivate::setRepaintRegion(AnnotationDocument::RepaintType
 {
     const bool emitRepaintNeeded = repaintRegion.isEmpty() || lastRepaintTypes != types;
     repaintRegion = invertedTransform.mapRect(canvasRect).toAlignedRect();
+    annotationsLayer.markAllDirty();
     lastRepaintTypes = types;
     if (emitRepaintNeeded) {
         Q_EMIT q->repaintNeeded(lastRepaintTypes);
@@ -1004,6 +1363,7 @@ void SelectedItemWrapper::applyTransform(const QMatrix4x4 &matrix)
     if (!selectedItem || !temp || matrix.isIdentity()) {
         return;
     }
+    d->document->d->setInteractiveEffects(true);
     d->document->d->setRepaintRegion(temp->renderRect());
     auto appliedTransform = matrix.toTransform();
     if (appliedTransform.type() == QTransform::TxTranslate) {
@@ -1025,6 +1385,7 @@ void SelectedItemWrapper::applyTransform(const QMatrix4x4 &matrix)
     // With a different order, the wrong scale/shear would be applied to translations.
     d->transform = d->transform * matrix;
     d->transform.optimize();
+    temp->updateRevision();
     d->document->d->setRepaintRegion(temp->renderRect());
     Q_EMIT transformChanged();
     Q_EMIT geometryPathChanged();
@@ -1033,6 +1394,7 @@ void SelectedItemWrapper::applyTransform(const QMatrix4x4 &matrix)
 
 bool SelectedItemWrapper::commitChanges()
 {
+    d->document->d->setInteractiveEffects(false);
     auto selectedItem = d->selectedItem.lock();
     auto &temp = d->document->d->tempItem;
     if (!selectedItem || !temp || !temp->isValid() //
@@ -1113,7 +1475,9 @@ void SelectedItemWrapper::setStrokeWidth(int width)
     }
     d->document->d->setRepaintRegion(temp->renderRect());
     stroke->pen.setWidthF(width);
-    Traits::reInitTraits(temp->traits());
+    Traits::clearStrokeForInit(temp->traits());
+    Traits::initOptTuple(temp->traits());
+    temp->updateRevision();
     d->document->d->setRepaintRegion(temp->renderRect());
     Q_EMIT strokeWidthChanged();
     Q_EMIT geometryPathChanged();
@@ -1142,6 +1506,7 @@ void SelectedItemWrapper::setStrokeColor(const QColor &color)
     }
     stroke->pen.setColor(color);
     Q_EMIT strokeColorChanged();
+    temp->updateRevision();
     d->document->d->setRepaintRegion(temp->renderRect());
 }
 
@@ -1169,6 +1534,7 @@ void SelectedItemWrapper::setFillColor(const QColor &color)
     }
     brush = color;
     Q_EMIT fillColorChanged();
+    temp->updateRevision();
     d->document->d->setRepaintRegion(temp->renderRect());
 }
 
@@ -1197,10 +1563,12 @@ void SelectedItemWrapper::setStrength(qreal strength)
     if (auto blur = std::get_if<Traits::Fill::Blur>(&fill); blur && blur->strength() != strength) {
         blur->setStrength(strength);
         Q_EMIT strengthChanged();
+        temp->updateRevision();
         d->document->d->setRepaintRegion(temp->renderRect());
     } else if (auto pixelate = std::get_if<Traits::Fill::Pixelate>(&fill); pixelate && pixelate->strength() != strength) {
         pixelate->setStrength(strength);
         Q_EMIT strengthChanged();
+        temp->updateRevision();
         d->document->d->setRepaintRegion(temp->renderRect());
     }
 }
@@ -1228,6 +1596,7 @@ void SelectedItemWrapper::setFont(const QFont &font)
     d->document->d->setRepaintRegion(temp->renderRect());
     text->font = font;
     Traits::reInitTraits(temp->traits());
+    temp->updateRevision();
     d->document->d->setRepaintRegion(temp->renderRect());
     Q_EMIT fontChanged();
     Q_EMIT geometryPathChanged();
@@ -1256,6 +1625,7 @@ void SelectedItemWrapper::setFontColor(const QColor &color)
     }
     text->brush = color;
     Q_EMIT fontColorChanged();
+    temp->updateRevision();
     d->document->d->setRepaintRegion(temp->renderRect());
 }
 
@@ -1284,6 +1654,7 @@ void SelectedItemWrapper::setNumber(int number)
     d->document->d->setRepaintRegion(temp->renderRect());
     text.value().emplace<Traits::Text::Number>(number);
     Traits::reInitTraits(temp->traits());
+    temp->updateRevision();
     d->document->d->setRepaintRegion(temp->renderRect());
     Q_EMIT numberChanged();
     Q_EMIT geometryPathChanged();
@@ -1315,6 +1686,7 @@ void SelectedItemWrapper::setText(const QString &string)
     d->document->d->setRepaintRegion(temp->renderRect());
     text.value().emplace<Traits::Text::String>(string);
     Traits::reInitTraits(temp->traits());
+    temp->updateRevision();
     d->document->d->setRepaintRegion(temp->renderRect());
     Q_EMIT textChanged();
     Q_EMIT geometryPathChanged();
@@ -1343,7 +1715,9 @@ void SelectedItemWrapper::setShadow(bool enabled)
     }
     d->document->d->setRepaintRegion(temp->renderRect());
     shadow->enabled = enabled;
-    Traits::reInitTraits(temp->traits());
+    Traits::clearShadowForInit(temp->traits());
+    Traits::initOptTuple(temp->traits());
+    temp->updateRevision();
     d->document->d->setRepaintRegion(temp->renderRect());
     Q_EMIT shadowChanged();
 }
@@ -13,6 +13,7 @@
 #include <QImage>
 #include <QMatrix4x4>
 #include <QObject>
+#include <QRegion>
 #include <QVariant>
 #include <qqmlregistration.h>
 #include "kquickimageeditor_export.h"
@@ -166,6 +167,17 @@ public:
      */
     Q_INVOKABLE void setBaseImage(const QUrl &localFile);
 
+    // The most bytes that the results of image effects can use before the least recently used
+    // ones are dropped. The default is 128 MiB.
+    qsizetype effectCacheBudget() const;
+    void setEffectCacheBudget(qsizetype bytes);
+
+    // How often the result of an image effect was found in the cache or had to be made,
+    // and how many bytes the cached results use now.
+    qint64 effectCacheHits() const;
+    qint64 effectCacheMisses() const;
+    qsizetype effectCacheBytes() const;
+
     /*!
      * \qmlmethod void AnnotationDocument::cropCanvas(rect cropRect)
      * Hide annotations that do not intersect with the rectangle and crop the image.
@@ -206,6 +218,18 @@ public:
     // This is lazily computed based on an internal paint region of areas needing to be repainted.
     QImage annotationsImage() const;
 
+    // Increases every time annotationsImage() repaints a part of the image.
+    quint64 annotationsVersion() const;
+
+    // How many threads annotationsImage() and renderToImage() can paint tiles of the image on,
+    // including the calling thread. 0, the default, means as many as QThreadPool::globalInstance()
+    // allows. 1 paints every tile in order on the calling thread, which tests can rely on.
+    int maxRenderThreads() const;
+    void setMaxRenderThreads(int threads);
+
+    // The parts of annotationsImage() that were repainted since it had `version`, in image pixels.
+    QRegion annotationsChangedSince(quint64 version) const;
+
     QImage renderToImage() const;
 
     /*!
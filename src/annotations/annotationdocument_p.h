@@ -5,7 +5,16 @@
 #pragma once
 
 #include "annotationdocument.h"
+#include "compositecheckpoints.h"
+#include "effectcache.h"
+#include "effectjobs.h"
 #include "history.h"
+#include "tiledlayer.h"
+
+#include <QRecursiveMutex>
+
+#include <map>
+#include <memory>
 
 class SelectedItemWrapperPrivate
 {
@@ -60,7 +69,10 @@ public:
     QImage baseImageCache;
     // An image containing just the annotations.
     // It is separate so that we don't need to keep repainting the image underneath.
-    QImage annotationsImage;
+    // Only the tiles touching the repaint region are repainted.
+    TiledLayer annotationsLayer;
+    // See AnnotationDocument::maxRenderThreads().
+    int maxRenderThreads = 0;
     // The last types of things to repaint. Used to determine when to emit repaintNeeded.
     AnnotationDocument::RepaintTypes lastRepaintTypes = AnnotationDocument::RepaintType::NoTypes;
     // Where a repaint is needed. Used to determine when to repaint or emit repaintNeeded.
@@ -72,6 +84,30 @@ public:
     // until the changes are committed.
     HistoryItem::shared_ptr tempItem;
     History history;
+    // The results of image effects, shared by all items.
+    // Mutable because effects are made while painting.
+    mutable EffectCache effectCache;
+    // Makes the results of image effects while a placeholder is painted.
+    mutable EffectJobs effectJobs;
+    // Whether to wait for the results of image effects when painting, like for saving.
+    mutable bool synchronousEffects = false;
+    // Tiles are painted on several threads, but image effects share the cache, jobs and
+    // checkpoints, so only one thread can paint them at a time. Recursive because painting
+    // the image under an effect can paint other effects.
+    mutable QRecursiveMutex effectsMutex;
+    // Whether an item is being drawn or transformed with the pointer. Image effects that aren't
+    // ready are made right away in interactive quality instead of waiting for the full one.
+    bool interactiveEffects = false;
+    // Where image effects were painted in interactive quality, repainted when interaction ends.
+    mutable QRegion interactiveRegion;
+    // EffectCache::Key::effect for shadows.
+    static constexpr int shadowEffect = -1;
+    // The key of the last shadow painted for each history item, so it can be dropped from
+    // effectCache when the item changes or leaves the history. Ordered by owner, so a new item
+    // at the address of a deleted one doesn't get its key.
+    mutable std::map<HistoryItem::const_weak_ptr, EffectCache::Key, std::owner_less<>> shadowSlots;
+    // Snapshots of the base image with history items painted over it, used by rangeImage().
+    mutable CompositeCheckpoints checkpoints;
 
     AnnotationDocumentPrivate(AnnotationDocument *q)
         : q(q)
@@ -105,9 +141,41 @@ public:
     // If the span is not set, all annotations intersecting the region will be painted.
     void paintAnnotations(QPainter *painter, const QRegion &imageRegion, std::optional<History::SubRange> range = std::nullopt) const;
 
+    // Paint an image effect made from the items in `untilNow` over `rect`.
+    // When `async` is true and the image isn't ready, it is made by effectJobs for `slot`
+    // and a placeholder is painted until it's done.
+    template<typename Effect>
+    void paintEffect(QPainter *painter, const Effect &effect, const QRectF &rect, History::SubRange untilNow, const EffectJobs::Slot &slot, bool async) const;
+
     // Get an image that only uses a part of the history.
+    // The range must start with the first item of the undo list.
+    // Starts from the checkpoint closest to the end of the range and adds one for the end.
     QImage rangeImage(History::SubRange range) const;
 
+    // Like rangeImage(), but only composites the pixels inside `pixels`, which are in image pixels.
+    // The image has the offset of its first pixel and is null if it would be empty.
+    // Doesn't add checkpoints, since it doesn't have the whole image.
+    QImage rangeImage(History::SubRange range, const QRect &pixels) const;
+
+    // The valid checkpoint closest to the end of `range`, or nullptr.
+    // `sources` is set to what the image of the range is made from.
+    const CompositeCheckpoints::Checkpoint *rangeCheckpoint(History::SubRange range, Traits::ImageEffects::Sources &sources) const;
+
+    // The blurred shadow of `renderedItem`, which is `item` or the temporary item replacing it.
+    // Made again only when the item changed since its shadow was cached.
+    QImage shadowImage(const HistoryItem::const_shared_ptr &item, const HistoryItem &renderedItem) const;
+
+    // Drop the shadows of items that are no longer in the undo or redo list.
+    void dropRemovedShadows();
+
+    // What the range paints inside the rect, for finding the results of image effects in the cache.
+    // Also includes what the image effects found inside the rect are made from.
+    Traits::ImageEffects::Sources effectSources(History::SubRange range, QRectF rect) const;
+
+    // Start or stop painting image effects in interactive quality.
+    // Stopping repaints the effects that were painted in interactive quality in full quality.
+    void setInteractiveEffects(bool interactive);
+
     void addItem(const HistoryItem::shared_ptr &item);
 
     // Repaint if rect size is more than 0x0 and intersects with the canvas.
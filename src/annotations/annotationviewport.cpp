@@ -31,8 +31,18 @@ public:
     bool allowDraggingSelection = false;
     bool acceptKeyReleaseEvents = false;
     QPainterPath hoveredMousePath;
+    // The item hoveredMousePath is from and its revision, so the path is only made when it changes.
+    HistoryItem::const_weak_ptr hoveredItem;
+    quint64 hoveredRevision = 0;
     bool repaintBaseImage = true;
     bool repaintAnnotations = true;
+    // The part of the annotations image shown in the annotations texture, scaled for the window.
+    QImage annotationsView;
+    // Where annotationsView is from and how big it is.
+    QRect annotationsImageView;
+    QSize annotationsViewSize;
+    // The version of the annotations image when annotationsView was last updated.
+    quint64 annotationsVersion = 0;
 
     AnnotationViewportPrivate(AnnotationViewport *q)
         : q(q)
@@ -46,6 +56,7 @@ public:
     void setPressed(bool pressed);
     void setAnyPressed();
     void setHoveredMousePath(const QPainterPath &path);
+    void setHoveredItem(const HistoryItem::const_shared_ptr &item);
     void setCursorForToolType();
 };
 
@@ -255,6 +266,16 @@ void AnnotationViewportPrivate::setHoveredMousePath(const QPainterPath &path)
     Q_EMIT q->hoveredMousePathChanged();
 }
 
+void AnnotationViewportPrivate::setHoveredItem(const HistoryItem::const_shared_ptr &item)
+{
+    if (item && item == hoveredItem.lock() && item->revision() == hoveredRevision) {
+        return;
+    }
+    hoveredItem = item;
+    hoveredRevision = item ? item->revision() : 0;
+    setHoveredMousePath(item ? Traits::interactivePath(item->traits()) : QPainterPath{});
+}
+
 void AnnotationViewport::hoverEnterEvent(QHoverEvent *event)
 {
     if (d->shouldIgnoreInput()) {
@@ -282,14 +303,9 @@ void AnnotationViewport::hoverMoveEvent(QHoverEvent *event)
         auto transform = d->document->d->inputTransform;
         auto [dx, dy] = d->inputOffset();
         transform.translate(dx, dy);
-        if (auto item = d->document->d->itemAt(transform.mapRect(forgivingRect))) {
-            auto &interactive = std::get<Traits::Interactive::Opt>(item->traits());
-            d->setHoveredMousePath(interactive->path);
-        } else {
-            d->setHoveredMousePath({});
-        }
+        d->setHoveredItem(d->document->d->itemAt(transform.mapRect(forgivingRect)));
     } else {
-        d->setHoveredMousePath({});
+        d->setHoveredItem(nullptr);
     }
 }
 
@@ -329,7 +345,7 @@ void AnnotationViewport::mousePressEvent(QMouseEvent *event)
 
     d->allowDraggingSelection = toolType == AnnotationTool::SelectTool && wrapper->hasSelection();
 
-    d->setHoveredMousePath({});
+    d->setHoveredItem(nullptr);
     d->setPressPosition(pressPos);
     d->setPressed(true);
     event->accept();
@@ -367,7 +383,7 @@ void AnnotationViewport::mouseMoveEvent(QMouseEvent *event)
         d->document->continueItem(transform.map(mousePos), options);
     }
 
-    d->setHoveredMousePath({});
+    d->setHoveredItem(nullptr);
     event->accept();
 }
 
@@ -485,7 +501,46 @@ QSGNode *AnnotationViewport::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeDa
 
     auto annotationsNode = node->annotationsNode();
     if (!annotationsNode->texture() || d->repaintAnnotations) {
-        annotationsNode->setTexture(window->createTextureFromImage(getImage(d->document->annotationsImage())));
+        const auto annotationsImage = d->document->annotationsImage();
+        const auto changed = d->document->annotationsChangedSince(d->annotationsVersion);
+        if (!annotationsNode->texture() || d->annotationsView.isNull() || imageView.isEmpty() //
+            || d->annotationsImageView != imageView || d->annotationsViewSize != windowImageSize //
+            || changed.boundingRect().contains(imageView)) {
+            // Own copy, so updating it doesn't detach the annotations image.
+            d->annotationsView = getImage(annotationsImage).copy();
+        } else if (!changed.isEmpty()) {
+            // Only the tiles that were repainted are copied and scaled again, with the same
+            // smooth scaling as the whole view so they don't stand out from the pixels around them.
+            QPainter painter(&d->annotationsView);
+            painter.setCompositionMode(QPainter::CompositionMode_Source);
+            const auto viewDpr = d->annotationsView.devicePixelRatio();
+            const auto viewRect = d->annotationsView.rect();
+            const qreal scaleX = qreal(viewRect.width()) / imageView.width();
+            const qreal scaleY = qreal(viewRect.height()) / imageView.height();
+            auto toView = [&](const QRectF &rect) {
+                return QRectF(rect.x() * scaleX, rect.y() * scaleY, rect.width() * scaleX, rect.height() * scaleY);
+            };
+            for (const auto &rect : changed.intersected(imageView)) {
+                // The whole pixels of the view that the rect covers.
+                const auto target = toView(rect.translated(-imageView.topLeft())).toAlignedRect().intersected(viewRect);
+                if (target.isEmpty()) {
+                    continue;
+                }
+                // Scaled with a pixel more around it, so its edges are blended with their neighbours.
+                const QRectF targetSource(target.x() / scaleX, target.y() / scaleY, target.width() / scaleX, target.height() / scaleY);
+                const auto source = targetSource.toAlignedRect().adjusted(-1, -1, 1, 1).intersected(imageView.translated(-imageView.topLeft()));
+                const auto scaledSource = toView(source);
+                auto scaled = annotationsImage.copy(source.translated(imageView.topLeft()))
+                                  .scaled(scaledSource.size().toSize(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+                scaled.setDevicePixelRatio(viewDpr);
+                const QPoint offset(qRound(scaledSource.x()), qRound(scaledSource.y()));
+                painter.drawImage(QPointF(target.topLeft()) / viewDpr, scaled, target.translated(-offset));
+            }
+        }
+        d->annotationsImageView = imageView;
+        d->annotationsViewSize = windowImageSize;
+        d->annotationsVersion = d->document->annotationsVersion();
+        annotationsNode->setTexture(window->createTextureFromImage(d->annotationsView));
         d->repaintAnnotations = false;
     }
 
@@ -0,0 +1,132 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#include "compositecheckpoints.h"
+
+#include <QSet>
+
+#include <algorithm>
+#include <cstring>
+
+static QRect tileRect(const QPoint &tile)
+{
+    using C = CompositeCheckpoints;
+    return {tile.x() * C::tileSize, tile.y() * C::tileSize, C::tileSize, C::tileSize};
+}
+
+CompositeCheckpoints::CompositeCheckpoints(qsizetype byteBudget)
+    : m_byteBudget(std::max<qsizetype>(byteBudget, 0))
+{
+}
+
+const CompositeCheckpoints::Checkpoint *CompositeCheckpoints::find(qsizetype position, const std::function<bool(const Checkpoint &)> &isValid)
+{
+    auto best = m_checkpoints.end();
+    for (auto it = m_checkpoints.begin(); it != m_checkpoints.end();) {
+        if (it->position > position || (best != m_checkpoints.end() && it->position <= best->position)) {
+            ++it;
+        } else if (!isValid(*it)) {
+            it = m_checkpoints.erase(it);
+        } else {
+            best = it++;
+        }
+    }
+    if (best == m_checkpoints.end()) {
+        return nullptr;
+    }
+    m_checkpoints.splice(m_checkpoints.begin(), m_checkpoints, best);
+    return &m_checkpoints.front();
+}
+
+void CompositeCheckpoints::insert(Checkpoint &&checkpoint)
+{
+    std::erase_if(m_checkpoints, [&checkpoint](const Checkpoint &other) {
+        return other.position == checkpoint.position;
+    });
+    m_checkpoints.push_front(std::move(checkpoint));
+    evict();
+}
+
+void CompositeCheckpoints::evict()
+{
+    // Dropping a checkpoint doesn't free the tiles it shares with others, so count again each time.
+    while (!m_checkpoints.empty() && bytes() > m_byteBudget) {
+        m_checkpoints.pop_back();
+    }
+}
+
+void CompositeCheckpoints::clear()
+{
+    m_checkpoints.clear();
+}
+
+qsizetype CompositeCheckpoints::byteBudget() const
+{
+    return m_byteBudget;
+}
+
+void CompositeCheckpoints::setByteBudget(qsizetype bytes)
+{
+    m_byteBudget = std::max<qsizetype>(bytes, 0);
+    evict();
+}
+
+qsizetype CompositeCheckpoints::bytes() const
+{
+    qsizetype bytes = 0;
+    QSet<qint64> counted;
+    for (const auto &checkpoint : m_checkpoints) {
+        for (const auto &tile : checkpoint.tiles) {
+            if (!counted.contains(tile.cacheKey())) {
+                counted.insert(tile.cacheKey());
+                bytes += tile.sizeInBytes();
+            }
+        }
+    }
+    return bytes;
+}
+
+bool CompositeCheckpoints::supports(const QImage &image)
+{
+    // Tiles are copied bytewise, so pixels must be whole bytes.
+    return !image.isNull() && image.depth() % 8 == 0;
+}
+
+void CompositeCheckpoints::restore(QImage &image, const Checkpoint &checkpoint, const QPoint &offset)
+{
+    const qsizetype pixelSize = image.depth() / 8;
+    const QRect imageRect{offset, image.size()};
+    for (auto it = checkpoint.tiles.cbegin(); it != checkpoint.tiles.cend(); ++it) {
+        const auto &tile = it.value();
+        // Tiles at the edges of the base image are smaller.
+        const QRect tilePixels{tileRect(it.key()).topLeft(), tile.size()};
+        const QRect rect = tilePixels.intersected(imageRect);
+        if (rect.isEmpty() || tile.format() != image.format()) {
+            continue;
+        }
+        const QPoint tilePos = rect.topLeft() - tilePixels.topLeft();
+        const QPoint imagePos = rect.topLeft() - offset;
+        for (int y = 0; y < rect.height(); ++y) {
+            std::memcpy(image.scanLine(imagePos.y() + y) + imagePos.x() * pixelSize,
+                        tile.constScanLine(tilePos.y() + y) + tilePos.x() * pixelSize,
+                        rect.width() * pixelSize);
+        }
+    }
+}
+
+QHash<QPoint, QImage> CompositeCheckpoints::updatedTiles(const QImage &image, const QRegion &changed, QHash<QPoint, QImage> tiles)
+{
+    QSet<QPoint> updated;
+    for (const QRect &rect : changed.intersected(image.rect())) {
+        for (int row = rect.top() / tileSize; row <= rect.bottom() / tileSize; ++row) {
+            for (int column = rect.left() / tileSize; column <= rect.right() / tileSize; ++column) {
+                const QPoint tile{column, row};
+                if (!updated.contains(tile)) {
+                    updated.insert(tile);
+                    tiles.insert(tile, image.copy(tileRect(tile).intersected(image.rect())));
+                }
+            }
+        }
+    }
+    return tiles;
+}
@@ -0,0 +1,76 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#pragma once
+
+#include "effectcache.h"
+
+#include <QHash>
+#include <QImage>
+#include <QPoint>
+#include <QRegion>
+
+#include <functional>
+#include <list>
+
+/**
+ * Snapshots of the base image with the first items of the history painted over it.
+ *
+ * Making the image under an image effect means painting every item before it. With a checkpoint
+ * for an earlier position, only the items after the checkpoint need to be painted.
+ *
+ * Checkpoints are stored as tiles of the base image that have been painted over. Tiles that
+ * didn't change since an earlier checkpoint are shared with it. When the tiles go over the byte
+ * budget, the least recently used checkpoints are dropped.
+ */
+class CompositeCheckpoints
+{
+public:
+    static constexpr int tileSize = 256;
+    static constexpr qsizetype defaultByteBudget = 64 * 1024 * 1024;
+
+    struct Checkpoint {
+        // How many items from the start of the undo list are painted.
+        qsizetype position = 0;
+        // What the checkpoint is made from. The revisions are in painting order.
+        Traits::ImageEffects::Sources sources;
+        // The tiles that differ from the base image, by their column and row.
+        QHash<QPoint, QImage> tiles;
+    };
+
+    explicit CompositeCheckpoints(qsizetype byteBudget = defaultByteBudget);
+
+    // The checkpoint with the highest position up to `position` for which `isValid` is true.
+    // Checkpoints found to be invalid are dropped. Returns nullptr if there is none.
+    // The pointer is valid until the checkpoints are changed.
+    const Checkpoint *find(qsizetype position, const std::function<bool(const Checkpoint &)> &isValid);
+
+    // Add a checkpoint, replacing the one at the same position.
+    void insert(Checkpoint &&checkpoint);
+
+    void clear();
+
+    qsizetype byteBudget() const;
+    void setByteBudget(qsizetype bytes);
+
+    // The bytes used by the tiles of all checkpoints. Shared tiles are only counted once.
+    qsizetype bytes() const;
+
+    // Whether checkpoints can be made for `image`.
+    static bool supports(const QImage &image);
+
+    // Copy the tiles of a checkpoint into `image`, which should be a copy of the base image
+    // or of the part of it at `offset`.
+    static void restore(QImage &image, const Checkpoint &checkpoint, const QPoint &offset = {});
+
+    // `tiles` with the tiles of `image` intersecting `changed` replaced.
+    // `changed` is in image pixels.
+    static QHash<QPoint, QImage> updatedTiles(const QImage &image, const QRegion &changed, QHash<QPoint, QImage> tiles);
+
+private:
+    void evict();
+
+    // Most recently used first.
+    std::list<Checkpoint> m_checkpoints;
+    qsizetype m_byteBudget;
+};
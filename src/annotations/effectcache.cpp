@@ -0,0 +1,106 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#include "effectcache.h"
+
+#include <algorithm>
+
+size_t qHash(const EffectCache::Key &key, size_t seed) noexcept
+{
+    const auto &revisions = key.sources.revisions;
+    return qHashMulti(seed,
+                      key.effect,
+                      key.sources.imageKey,
+                      qHashRange(revisions.begin(), revisions.end()),
+                      key.rect.x(),
+                      key.rect.y(),
+                      key.rect.width(),
+                      key.rect.height(),
+                      key.strength,
+                      key.dpr,
+                      int(key.quality));
+}
+
+EffectCache::EffectCache(qsizetype byteBudget)
+    : m_byteBudget(std::max<qsizetype>(byteBudget, 0))
+{
+}
+
+QImage EffectCache::find(const Key &key)
+{
+    auto it = m_index.constFind(key);
+    if (it == m_index.cend()) {
+        ++m_stats.misses;
+        return {};
+    }
+    ++m_stats.hits;
+    m_entries.splice(m_entries.begin(), m_entries, it.value());
+    return m_entries.front().second;
+}
+
+void EffectCache::insert(const Key &key, const QImage &image)
+{
+    remove(key);
+    const qsizetype bytes = image.sizeInBytes();
+    if (image.isNull() || bytes > m_byteBudget) {
+        return;
+    }
+    evict(bytes);
+    m_entries.emplace_front(key, image);
+    m_index.insert(key, m_entries.begin());
+    m_stats.bytes += bytes;
+    ++m_stats.count;
+}
+
+void EffectCache::remove(const Key &key)
+{
+    if (auto it = m_index.find(key); it != m_index.end()) {
+        m_stats.bytes -= it.value()->second.sizeInBytes();
+        --m_stats.count;
+        m_entries.erase(it.value());
+        m_index.erase(it);
+    }
+}
+
+void EffectCache::evict(qsizetype bytesNeeded)
+{
+    while (!m_entries.empty() && m_stats.bytes + bytesNeeded > m_byteBudget) {
+        const auto &entry = m_entries.back();
+        m_stats.bytes -= entry.second.sizeInBytes();
+        --m_stats.count;
+        ++m_stats.evictions;
+        m_index.remove(entry.first);
+        m_entries.pop_back();
+    }
+}
+
+void EffectCache::clear()
+{
+    m_entries.clear();
+    m_index.clear();
+    m_stats.bytes = 0;
+    m_stats.count = 0;
+}
+
+qsizetype EffectCache::byteBudget() const
+{
+    return m_byteBudget;
+}
+
+void EffectCache::setByteBudget(qsizetype bytes)
+{
+    m_byteBudget = std::max<qsizetype>(bytes, 0);
+    evict(0);
+}
+
+EffectCache::Stats EffectCache::stats() const
+{
+    return m_stats;
+}
+
+void EffectCache::resetStats()
+{
+    m_stats.hits = 0;
+    m_stats.misses = 0;
+    m_stats.evictions = 0;
+}
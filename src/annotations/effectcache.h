@@ -0,0 +1,101 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#pragma once
+
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QRect>
+
+#include <list>
+
+namespace Traits::ImageEffects
+{
+// What the original image of an image effect is made from.
+struct Sources {
+    // QImage::cacheKey() of the image the items are painted over.
+    qint64 imageKey = 0;
+    // HistoryItem::revision() of every item painted over the source rect, topmost first.
+    QList<quint64> revisions;
+    bool operator==(const Sources &other) const = default;
+};
+
+enum class Quality {
+    // The same as making the effect on the whole image.
+    Full,
+    // Made from a scaled down image or sampled, for quick updates while the effect is edited.
+    Interactive,
+};
+}
+
+/**
+ * The results of image effects for a whole document, shared by all items and their copies.
+ *
+ * Results are found by what they were made from, so copies of an item don't need their own results
+ * and results that can't be found anymore aren't kept around for long. When adding a result would
+ * go over the byte budget, the least recently used results are dropped until it fits.
+ */
+class EffectCache
+{
+public:
+    struct Key {
+        // Which effect made the result. Traits::Fill::Type for the image effects of annotations
+        // and AnnotationDocumentPrivate::shadowEffect for their shadows.
+        int effect = 0;
+        Traits::ImageEffects::Sources sources;
+        // The rect of the result in image pixels.
+        QRect rect;
+        qreal strength = 0;
+        qreal dpr = 1;
+        Traits::ImageEffects::Quality quality = Traits::ImageEffects::Quality::Full;
+        bool operator==(const Key &other) const = default;
+    };
+
+    struct Stats {
+        qint64 hits = 0;
+        qint64 misses = 0;
+        qint64 evictions = 0;
+        // The bytes used by all results.
+        qsizetype bytes = 0;
+        qsizetype count = 0;
+    };
+
+    static constexpr qsizetype defaultByteBudget = 128 * 1024 * 1024;
+
+    explicit EffectCache(qsizetype byteBudget = defaultByteBudget);
+
+    // The result for the key or a null image if there isn't one.
+    // Counts as a hit or a miss and makes the result the most recently used one.
+    QImage find(const Key &key);
+
+    // Add or replace the result for the key.
+    // Results bigger than the whole budget are not added.
+    void insert(const Key &key, const QImage &image);
+
+    // Drop the result for the key, if there is one. Not counted as an eviction.
+    void remove(const Key &key);
+
+    // Drop all results. The hit, miss and eviction counts are kept.
+    void clear();
+
+    qsizetype byteBudget() const;
+    // Drops the least recently used results until the rest fits the new budget.
+    void setByteBudget(qsizetype bytes);
+
+    Stats stats() const;
+    // Set the hit, miss and eviction counts to 0.
+    void resetStats();
+
+private:
+    using Entry = std::pair<Key, QImage>;
+    void evict(qsizetype bytesNeeded);
+
+    // Most recently used first.
+    std::list<Entry> m_entries;
+    QHash<Key, std::list<Entry>::iterator> m_index;
+    qsizetype m_byteBudget;
+    Stats m_stats;
+};
+
+size_t qHash(const EffectCache::Key &key, size_t seed = 0) noexcept;
@@ -0,0 +1,127 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#include "effectjobs.h"
+
+#include <QMutexLocker>
+
+#include <algorithm>
+
+static bool isSameSlot(const EffectJobs::Slot &a, const EffectJobs::Slot &b)
+{
+    return !a.owner_before(b) && !b.owner_before(a);
+}
+
+EffectJobs::EffectJobs(QObject *parent)
+    : QObject(parent)
+{
+    // One job at a time. The effects spread their own work over QThreadPool::globalInstance().
+    m_pool.setMaxThreadCount(1);
+}
+
+EffectJobs::~EffectJobs()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        for (const auto &job : std::as_const(m_jobs)) {
+            *job.cancelled = true;
+        }
+    }
+    m_pool.waitForDone();
+}
+
+void EffectJobs::start(const Slot &slot, const EffectCache::Key &key, std::function<QImage()> &&render)
+{
+    QMutexLocker locker(&m_mutex);
+    if (hasJob(key)) {
+        return;
+    }
+    m_jobs.removeIf([&slot](const Job &job) {
+        if (isSameSlot(job.slot, slot)) {
+            *job.cancelled = true;
+            return true;
+        }
+        return false;
+    });
+
+    const Job job{++m_nextId, slot, key, std::make_shared<std::atomic_bool>(false)};
+    m_jobs.append(job);
+    m_pool.start([this, id = job.id, cancelled = job.cancelled, render = std::move(render)] {
+        if (*cancelled) {
+            return;
+        }
+        auto image = render();
+        if (*cancelled) {
+            return;
+        }
+        {
+            QMutexLocker locker(&m_doneMutex);
+            m_done.append({id, std::move(image)});
+        }
+        QMetaObject::invokeMethod(this, &EffectJobs::deliver, Qt::QueuedConnection);
+    });
+}
+
+bool EffectJobs::isPending(const EffectCache::Key &key) const
+{
+    QMutexLocker locker(&m_mutex);
+    return hasJob(key);
+}
+
+bool EffectJobs::hasJob(const EffectCache::Key &key) const
+{
+    return std::any_of(m_jobs.cbegin(), m_jobs.cend(), [&key](const Job &job) {
+        return job.key == key;
+    });
+}
+
+EffectJobs::Result EffectJobs::lastResult(const Slot &slot) const
+{
+    QMutexLocker locker(&m_mutex);
+    for (const auto &[resultSlot, result] : m_lastResults) {
+        if (isSameSlot(resultSlot, slot)) {
+            return result;
+        }
+    }
+    return {};
+}
+
+void EffectJobs::waitForDone()
+{
+    m_pool.waitForDone();
+    deliver();
+}
+
+void EffectJobs::deliver()
+{
+    QList<std::pair<quint64, QImage>> done;
+    {
+        QMutexLocker locker(&m_doneMutex);
+        done.swap(m_done);
+    }
+    for (auto &[id, image] : done) {
+        QMutexLocker locker(&m_mutex);
+        auto it = std::find_if(m_jobs.begin(), m_jobs.end(), [id](const Job &job) {
+            return job.id == id;
+        });
+        // Cancelled after it was done.
+        if (it == m_jobs.end()) {
+            continue;
+        }
+        const auto job = *it;
+        m_jobs.erase(it);
+
+        m_lastResults.removeIf([&job](const std::pair<Slot, Result> &result) {
+            return isSameSlot(result.first, job.slot);
+        });
+        m_lastResults.prepend({job.slot, {job.key, image}});
+        if (m_lastResults.size() > maxLastResults) {
+            m_lastResults.removeLast();
+        }
+        // Receivers can start other jobs.
+        locker.unlock();
+        Q_EMIT finished(job.key, image);
+    }
+}
+
+#include "moc_effectjobs.cpp"
@@ -0,0 +1,82 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#pragma once
+
+#include "effectcache.h"
+
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QThreadPool>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+/**
+ * Makes the images of image effects on a worker thread, so painting doesn't have to wait for them.
+ *
+ * Each job is for a slot, which is whatever the effect belongs to, such as a history item.
+ * Slots are compared by owner, so a new object at the address of a deleted one is another slot.
+ * Starting a job for a slot supersedes the unfinished job for the same slot, which is cancelled.
+ * The last image made for each of the recently used slots is kept so it can be painted in place
+ * of an image that isn't done yet.
+ *
+ * start(), isPending() and lastResult() can be called from any thread, such as the threads that
+ * paint tiles. Finished jobs are delivered on the thread of this object.
+ */
+class EffectJobs : public QObject
+{
+    Q_OBJECT
+public:
+    using Slot = std::weak_ptr<const void>;
+
+    explicit EffectJobs(QObject *parent = nullptr);
+    // Cancels all jobs and waits for the running one.
+    ~EffectJobs() override;
+
+    // Make the image for `key` with `render` on the worker thread, unless it is already being made.
+    // `render` must be safe to call from another thread.
+    void start(const Slot &slot, const EffectCache::Key &key, std::function<QImage()> &&render);
+
+    bool isPending(const EffectCache::Key &key) const;
+
+    struct Result {
+        EffectCache::Key key;
+        QImage image;
+    };
+    // The last image made for `slot`. The image is null if none was made.
+    Result lastResult(const Slot &slot) const;
+
+    // Wait for all started jobs and emit finished() for them.
+    void waitForDone();
+
+Q_SIGNALS:
+    // Emitted on the thread of this object when a job that wasn't cancelled is done.
+    // The image can be null if the effect had nothing to make it from.
+    void finished(const EffectCache::Key &key, const QImage &image);
+
+private:
+    struct Job {
+        quint64 id = 0;
+        Slot slot;
+        EffectCache::Key key;
+        std::shared_ptr<std::atomic_bool> cancelled;
+    };
+    void deliver();
+    bool hasJob(const EffectCache::Key &key) const;
+
+    static constexpr qsizetype maxLastResults = 16;
+
+    // Guards the jobs and the last results.
+    mutable QMutex m_mutex;
+    QList<Job> m_jobs;
+    quint64 m_nextId = 0;
+    // Most recently made first.
+    QList<std::pair<Slot, Result>> m_lastResults;
+    // Images made by the worker thread that haven't been delivered yet, by job ID.
+    QMutex m_doneMutex;
+    QList<std::pair<quint64, QImage>> m_done;
+    QThreadPool m_pool;
+};
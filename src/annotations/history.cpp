@@ -4,10 +4,32 @@
 
 #include "history.h"
 #include <QDebug>
+#include <atomic>
 #include <ranges>
 
 using namespace Qt::StringLiterals;
 
+bool HistoryItem::operator==(const HistoryItem &other) const
+{
+    return m_parent == other.m_parent && m_child == other.m_child && m_traits == other.m_traits;
+}
+
+quint64 HistoryItem::nextRevision()
+{
+    static std::atomic<quint64> revision = 0;
+    return ++revision;
+}
+
+quint64 HistoryItem::revision() const
+{
+    return m_revision;
+}
+
+void HistoryItem::updateRevision()
+{
+    m_revision = nextRevision();
+}
+
 bool HistoryItem::hasParent() const
 {
     return m_parent && !m_parent->expired();
@@ -153,9 +175,11 @@ History::List::size_type eraseInvalidItems(History::List &list, It first, It las
 //---
 
 History::History(const List &undoList, const List &redoList)
-    : m_undoList(undoList)
-    , m_redoList(redoList)
+    : m_redoList(redoList)
 {
+    for (const auto &item : undoList) {
+        pushUndoItem(HistoryItem::shared_ptr{item});
+    }
 }
 
 bool History::operator==(const History &other) const
@@ -213,9 +237,9 @@ History::ListsChangedResult History::push(const HistoryItem::shared_ptr &item)
         return {false, false};
     }
     if (!m_undoList.empty() && (!m_undoList.back() || !m_undoList.back()->isValid())) {
-        m_undoList.pop_back();
+        popUndoItem();
     }
-    m_undoList.push_back(item);
+    pushUndoItem(HistoryItem::shared_ptr{item});
     return {true, clearRedoList()};
 }
 
@@ -224,8 +248,7 @@ History::ItemReplacedResult History::pop()
     if (m_undoList.empty()) {
         return {nullptr, false};
     }
-    auto item = std::move(m_undoList.back());
-    m_undoList.erase(m_undoList.cend() - 1);
+    auto item = popUndoItem();
     return {item, eraseInvalidRedoItems()};
 }
 
@@ -234,8 +257,7 @@ bool History::undo()
     if (m_undoList.empty()) {
         return false;
     }
-    m_redoList.push_back(std::move(m_undoList.back()));
-    m_undoList.erase(m_undoList.cend() - 1);
+    m_redoList.push_back(popUndoItem());
     return true;
 }
 
@@ -244,11 +266,31 @@ bool History::redo()
     if (m_redoList.empty()) {
         return false;
     }
-    m_undoList.push_back(std::move(m_redoList.back()));
+    pushUndoItem(std::move(m_redoList.back()));
     m_redoList.erase(m_redoList.cend() - 1);
     return true;
 }
 
+void History::pushUndoItem(HistoryItem::shared_ptr &&item)
+{
+    if (item) {
+        m_undoIndexes.insert(item.get(), m_undoList.size());
+    }
+    m_undoList.push_back(std::move(item));
+    updateParentIndex(m_undoList.back());
+    updateIndex(currentIndex());
+}
+
+HistoryItem::shared_ptr History::popUndoItem()
+{
+    auto item = std::move(m_undoList.back());
+    m_undoList.erase(m_undoList.cend() - 1);
+    m_undoIndexes.remove(item.get());
+    m_visibleIndex.remove(m_undoList.size());
+    updateParentIndex(item);
+    return item;
+}
+
 bool History::clearRedoList()
 {
     if (m_redoList.empty()) {
@@ -270,6 +312,8 @@ bool History::clearUndoList()
     while (!m_undoList.empty()) {
         m_undoList.erase(m_undoList.cend() - 1);
     }
+    m_undoIndexes.clear();
+    m_visibleIndex.clear();
     return oldSize != m_undoList.size();
 }
 
@@ -284,9 +328,47 @@ bool History::itemVisible(const HistoryItem::const_shared_ptr &item) const
         return false;
     }
     auto child = item->m_child.lock();
-    // Searching in reverse order should be a bit faster.
-    // If the returned iterator is equal to crend, then the child wasn't found.
-    return !child || std::find(m_undoList.crbegin(), m_undoList.crend(), child) == m_undoList.crend();
+    return !child || !m_undoIndexes.contains(child.get());
+}
+
+History::List::size_type History::indexOf(const HistoryItem::const_shared_ptr &item) const
+{
+    return m_undoIndexes.value(item.get(), -1);
+}
+
+const SpatialIndex &History::visibleIndex() const
+{
+    return m_visibleIndex;
+}
+
+void History::updateItem(const HistoryItem::const_shared_ptr &item)
+{
+    if (const auto index = indexOf(item); index >= 0) {
+        updateIndex(index);
+    }
+}
+
+void History::updateIndex(List::size_type index)
+{
+    const auto &item = m_undoList.at(index);
+    if (!itemVisible(item)) {
+        m_visibleIndex.remove(index);
+        return;
+    }
+    QRectF rect;
+    if (auto &visual = std::get<Traits::Visual::Opt>(item->traits())) {
+        rect = visual->rect;
+    }
+    // Without making the shape, since items aren't always hit tested.
+    rect |= Traits::hitBounds(item->traits());
+    m_visibleIndex.insert(index, rect);
+}
+
+void History::updateParentIndex(const HistoryItem::const_shared_ptr &item)
+{
+    if (item) {
+        updateItem(item->parent().lock());
+    }
 }
 
 History::IdType History::unmodifiedId() const
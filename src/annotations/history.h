@@ -4,7 +4,9 @@
 
 #pragma once
 
+#include "spatialindex.h"
 #include "traits.h"
+#include <QHash>
 #include <ranges>
 
 class HistoryItem;
@@ -72,7 +74,8 @@ public:
     using weak_ptr = shared_ptr::weak_type;
     using const_weak_ptr = const_shared_ptr::weak_type;
 
-    bool operator==(const HistoryItem &other) const = default;
+    // The revision is not compared.
+    bool operator==(const HistoryItem &other) const;
 
     bool hasParent() const;
     HistoryItem::const_weak_ptr parent() const;
@@ -86,6 +89,15 @@ public:
     // Get a reference to the tuple of all traits.
     Traits::OptTuple &traits(); // can modify
 
+    // A number identifying the current state of the traits.
+    // Every new item and every call to updateRevision() gets a revision no other state had before.
+    // Copies keep the revision because they render the same, so image effects painted over an item
+    // or its temporary copy can tell whether it changed since their cache was made.
+    quint64 revision() const;
+
+    // Must be called after the traits have been modified in place.
+    void updateRevision();
+
     // Whether this item's traits and parent properties are valid.
     bool isValid() const;
 
@@ -114,6 +126,10 @@ protected:
     mutable std::optional<HistoryItem::const_weak_ptr> m_parent;
     mutable HistoryItem::const_weak_ptr m_child;
     Traits::OptTuple m_traits;
+    quint64 m_revision = nextRevision();
+
+private:
+    static quint64 nextRevision();
 };
 
 QDebug operator<<(QDebug debug, const HistoryItem &item);
@@ -197,6 +213,16 @@ public:
     // Whether the item is visible, in the undo list and without a child also in the undo list.
     bool itemVisible(const HistoryItem::const_shared_ptr &item) const;
 
+    // The index of the item in the undo list or -1 if it isn't in the undo list.
+    List::size_type indexOf(const HistoryItem::const_shared_ptr &item) const;
+
+    // The bounds of the visible items, by their index in the undo list.
+    // Includes the visual rect and the rect used for mouse interaction.
+    const SpatialIndex &visibleIndex() const;
+
+    // Must be called after the traits of an item in the undo list have been modified in place.
+    void updateItem(const HistoryItem::const_shared_ptr &item);
+
     static inline IdType itemId(const auto &item) noexcept
     {
         return qHash(item.get());
@@ -219,8 +245,19 @@ protected:
     bool clearUndoList();
     bool eraseInvalidRedoItems();
 
+    // Add the item to the end of the undo list or remove it, keeping track of its index
+    // and updating the visibility of its parent, which the item hides.
+    void pushUndoItem(HistoryItem::shared_ptr &&item);
+    HistoryItem::shared_ptr popUndoItem();
+    // Add the item at the index to visibleIndex() if it's visible or remove it if not.
+    void updateIndex(List::size_type index);
+    void updateParentIndex(const HistoryItem::const_shared_ptr &item);
+
     List m_undoList;
     List m_redoList;
+    // The index of every item in the undo list, so finding an item doesn't need a search.
+    QHash<const HistoryItem *, List::size_type> m_undoIndexes;
+    SpatialIndex m_visibleIndex;
 
     IdType m_unmodifiedId = 0;
 };
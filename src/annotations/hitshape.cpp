@@ -0,0 +1,151 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#include "hitshape.h"
+
+#include <QPainterPath>
+#include <QTransform>
+
+#include <algorithm>
+
+static qreal squaredDistanceToSegment(const QPointF &point, const QPointF &start, const QPointF &end)
+{
+    const auto segment = end - start;
+    const auto length = QPointF::dotProduct(segment, segment);
+    const auto t = length > 0 ? std::clamp(QPointF::dotProduct(point - start, segment) / length, 0.0, 1.0) : 0.0;
+    const auto difference = point - (start + t * segment);
+    return QPointF::dotProduct(difference, difference);
+}
+
+// Which side of the line through `start` and `end` `point` is on.
+static qreal side(const QPointF &start, const QPointF &end, const QPointF &point)
+{
+    return (end.x() - start.x()) * (point.y() - start.y()) - (point.x() - start.x()) * (end.y() - start.y());
+}
+
+// How many times `polygon` winds around `point`, counterclockwise being positive.
+// The last point is connected to the first.
+static int windingNumber(const QPolygonF &polygon, const QPointF &point)
+{
+    int winding = 0;
+    for (qsizetype i = 0; i < polygon.size(); ++i) {
+        const auto &start = polygon[i];
+        const auto &end = polygon[(i + 1) % polygon.size()];
+        if (start.y() <= point.y()) {
+            if (end.y() > point.y() && side(start, end, point) > 0) {
+                ++winding;
+            }
+        } else if (end.y() <= point.y() && side(start, end, point) < 0) {
+            --winding;
+        }
+    }
+    return winding;
+}
+
+void HitShape::addPath(const QPainterPath &path, bool filled)
+{
+    auto polylines = path.toSubpathPolygons();
+    if (filled) {
+        for (auto &polyline : polylines) {
+            m_polylines.insert(m_filledCount++, std::move(polyline));
+        }
+    } else {
+        m_polylines.append(polylines);
+    }
+    updateBounds();
+}
+
+qreal HitShape::halfWidth() const
+{
+    return m_halfWidth;
+}
+
+void HitShape::setHalfWidth(qreal halfWidth)
+{
+    m_halfWidth = halfWidth;
+}
+
+bool HitShape::isEmpty() const
+{
+    return m_polylines.isEmpty();
+}
+
+QRectF HitShape::boundingRect() const
+{
+    if (isEmpty()) {
+        return {};
+    }
+    return m_bounds.adjusted(-m_halfWidth, -m_halfWidth, m_halfWidth, m_halfWidth);
+}
+
+bool HitShape::contains(const QPointF &point, qreal radius) const
+{
+    const auto distance = m_halfWidth + radius;
+    const auto bounds = m_bounds.adjusted(-distance, -distance, distance, distance);
+    if (isEmpty() || point.x() < bounds.left() || point.x() > bounds.right() //
+        || point.y() < bounds.top() || point.y() > bounds.bottom()) {
+        return false;
+    }
+    const auto squaredDistance = distance * distance;
+    for (const auto &polyline : m_polylines) {
+        if (polyline.size() == 1 && squaredDistanceToSegment(point, polyline[0], polyline[0]) <= squaredDistance) {
+            return true;
+        }
+        for (qsizetype i = 1; i < polyline.size(); ++i) {
+            const auto &start = polyline[i - 1];
+            const auto &end = polyline[i];
+            // Cheaper than the distance for most of the lines.
+            if (std::min(start.x(), end.x()) - distance > point.x() || std::max(start.x(), end.x()) + distance < point.x()
+                || std::min(start.y(), end.y()) - distance > point.y() || std::max(start.y(), end.y()) + distance < point.y()) {
+                continue;
+            }
+            if (squaredDistanceToSegment(point, start, end) <= squaredDistance) {
+                return true;
+            }
+        }
+    }
+    int winding = 0;
+    for (qsizetype i = 0; i < m_filledCount; ++i) {
+        const auto &polygon = m_polylines[i];
+        winding += windingNumber(polygon, point);
+        // The edge closing the polygon only has a width when testing with a radius.
+        if (radius > 0 && squaredDistanceToSegment(point, polygon.constLast(), polygon.constFirst()) <= radius * radius) {
+            return true;
+        }
+    }
+    return winding != 0;
+}
+
+void HitShape::translate(qreal dx, qreal dy)
+{
+    for (auto &polyline : m_polylines) {
+        polyline.translate(dx, dy);
+    }
+    m_bounds.translate(dx, dy);
+}
+
+void HitShape::transform(const QTransform &transform)
+{
+    for (auto &polyline : m_polylines) {
+        polyline = transform.map(polyline);
+    }
+    updateBounds();
+}
+
+void HitShape::updateBounds()
+{
+    if (m_polylines.isEmpty()) {
+        m_bounds = {};
+        return;
+    }
+    // Unlike QRectF::united(), keeps polylines without a width or height.
+    QPointF topLeft = m_polylines.constFirst().constFirst();
+    QPointF bottomRight = topLeft;
+    for (const auto &polyline : std::as_const(m_polylines)) {
+        for (const auto &point : polyline) {
+            topLeft = {std::min(topLeft.x(), point.x()), std::min(topLeft.y(), point.y())};
+            bottomRight = {std::max(bottomRight.x(), point.x()), std::max(bottomRight.y(), point.y())};
+        }
+    }
+    m_bounds = {topLeft, bottomRight};
+}
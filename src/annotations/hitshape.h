@@ -0,0 +1,54 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#pragma once
+
+#include <QList>
+#include <QPolygonF>
+#include <QRectF>
+
+class QPainterPath;
+class QTransform;
+
+/**
+ * The area of an item that can be clicked, tested with distances to lines instead of by
+ * stroking and simplifying paths.
+ *
+ * A point hits the shape when it is within the half width of one of its polylines or inside of
+ * the filled ones with the winding fill rule. Curves are flattened into polylines once, when
+ * they are added.
+ */
+class HitShape
+{
+public:
+    HitShape() = default;
+
+    // Add the subpaths of `path`. Filled subpaths are closed for testing their inside.
+    void addPath(const QPainterPath &path, bool filled);
+
+    qreal halfWidth() const;
+    void setHalfWidth(qreal halfWidth);
+
+    bool isEmpty() const;
+    // The polylines extended by the half width.
+    QRectF boundingRect() const;
+
+    // Whether a circle at `point` with `radius` touches the shape.
+    bool contains(const QPointF &point, qreal radius = 0) const;
+
+    void translate(qreal dx, qreal dy);
+    // The half width isn't transformed, like pen widths aren't when paths are transformed.
+    void transform(const QTransform &transform);
+
+    bool operator==(const HitShape &other) const = default;
+
+private:
+    void updateBounds();
+
+    // The filled ones are first.
+    QList<QPolygonF> m_polylines;
+    qsizetype m_filledCount = 0;
+    qreal m_halfWidth = 0;
+    // Of the polylines, without the half width.
+    QRectF m_bounds;
+};
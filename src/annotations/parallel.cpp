@@ -0,0 +1,54 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#include "parallel_p.h"
+
+#include <QSemaphore>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+void Parallel::forEachBand(int lineCount, int granularity, int maxThreads, const std::function<void(int first, int count)> &work)
+{
+    auto pool = QThreadPool::globalInstance();
+    if (maxThreads <= 0) {
+        maxThreads = pool->maxThreadCount();
+    }
+    const int units = (lineCount + granularity - 1) / granularity;
+    const int bandCount = std::clamp(units, 1, std::max(maxThreads, 1));
+    if (bandCount == 1) {
+        work(0, lineCount);
+        return;
+    }
+
+    // Bands are claimed by whichever thread gets to them first, including the calling thread.
+    // So the caller never waits on tasks that haven't started, even if the pool is busy
+    // or we are running in one of its threads. Tasks starting after all bands have been
+    // claimed only touch the shared state and return.
+    struct State {
+        std::atomic_int next = 0;
+        QSemaphore done;
+        std::function<void(int)> runBand;
+    };
+    auto state = std::make_shared<State>();
+    state->runBand = [&work, lineCount, granularity, units, bandCount](int band) {
+        const int first = std::min(units * band / bandCount * granularity, lineCount);
+        const int last = std::min(units * (band + 1) / bandCount * granularity, lineCount);
+        work(first, last - first);
+    };
+    auto runBands = [bandCount](State &state) {
+        for (int band = state.next++; band < bandCount; band = state.next++) {
+            state.runBand(band);
+            state.done.release();
+        }
+    };
+    for (int i = 1; i < bandCount; ++i) {
+        pool->start([state, runBands] {
+            runBands(*state);
+        });
+    }
+    runBands(*state);
+    state->done.acquire(bandCount);
+}
@@ -0,0 +1,17 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#pragma once
+
+#include <functional>
+
+namespace Parallel
+{
+/**
+ * Splits `lineCount` lines into consecutive bands and calls `work` for each of them
+ * on up to `maxThreads` threads of QThreadPool::globalInstance(), including the calling thread.
+ * Bands start at multiples of `granularity` lines. A `maxThreads` of 0 or less means
+ * QThreadPool::maxThreadCount(). Returns when all bands are done.
+ */
+void forEachBand(int lineCount, int granularity, int maxThreads, const std::function<void(int first, int count)> &work);
+}
@@ -0,0 +1,332 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#include "pathsimplification.h"
+
+#include <QList>
+#include <QtMath>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <tuple>
+
+using Points = QList<QPointF>;
+using Bezier = std::array<QPointF, 4>;
+
+// Turning more than 45 degrees at a point makes it a corner.
+static constexpr qreal cornerCosine = 0.7071;
+// Newton-Raphson iterations before giving up and splitting the points.
+static constexpr int maxReparameterizations = 4;
+
+static qreal dot(const QPointF &a, const QPointF &b)
+{
+    return QPointF::dotProduct(a, b);
+}
+
+static qreal squaredLength(const QPointF &vector)
+{
+    return dot(vector, vector);
+}
+
+static QPointF unit(const QPointF &vector)
+{
+    const auto length = std::sqrt(squaredLength(vector));
+    return length > 0 ? vector / length : QPointF{};
+}
+
+static QPointF bezierPoint(const Bezier &bezier, qreal t)
+{
+    const auto s = 1 - t;
+    return s * s * s * bezier[0] + 3 * s * s * t * bezier[1] + 3 * s * t * t * bezier[2] + t * t * t * bezier[3];
+}
+
+static QPointF bezierDerivative(const Bezier &bezier, qreal t)
+{
+    const auto s = 1 - t;
+    return 3 * s * s * (bezier[1] - bezier[0]) + 6 * s * t * (bezier[2] - bezier[1]) + 3 * t * t * (bezier[3] - bezier[2]);
+}
+
+static QPointF bezierSecondDerivative(const Bezier &bezier, qreal t)
+{
+    return 6 * (1 - t) * (bezier[2] - 2 * bezier[1] + bezier[0]) + 6 * t * (bezier[3] - 2 * bezier[2] + bezier[1]);
+}
+
+static qreal squaredDistanceToSegment(const QPointF &point, const QPointF &start, const QPointF &end)
+{
+    const auto segment = end - start;
+    const auto length = squaredLength(segment);
+    if (length == 0) {
+        return squaredLength(point - start);
+    }
+    const auto t = std::clamp(dot(point - start, segment) / length, 0.0, 1.0);
+    return squaredLength(point - (start + t * segment));
+}
+
+// The points ending the elements of each subpath, without points repeated one after another.
+static QList<Points> subpathPoints(const QPainterPath &path)
+{
+    QList<Points> subpaths;
+    for (int i = 0; i < path.elementCount(); ++i) {
+        const auto element = path.elementAt(i);
+        if (element.isMoveTo()) {
+            subpaths.append({element});
+            continue;
+        }
+        if (element.isCurveTo()) {
+            // Followed by 2 CurveToDataElements, the last one being the end of the curve.
+            i += 2;
+        }
+        const QPointF point = path.elementAt(i);
+        if (point != subpaths.last().constLast()) {
+            subpaths.last().append(point);
+        }
+    }
+    return subpaths;
+}
+
+// Ramer–Douglas–Peucker. Marks the points that are kept.
+static QList<bool> decimate(const Points &points, qreal squaredTolerance)
+{
+    QList<bool> kept(points.size(), false);
+    kept.first() = true;
+    kept.last() = true;
+    // Without recursion, since long paths can have thousands of points.
+    QList<std::pair<qsizetype, qsizetype>> ranges{{0, points.size() - 1}};
+    while (!ranges.isEmpty()) {
+        const auto [first, last] = ranges.takeLast();
+        qreal maxDistance = 0;
+        qsizetype farthest = -1;
+        for (auto i = first + 1; i < last; ++i) {
+            const auto distance = squaredDistanceToSegment(points[i], points[first], points[last]);
+            if (distance > maxDistance) {
+                maxDistance = distance;
+                farthest = i;
+            }
+        }
+        if (farthest != -1 && maxDistance > squaredTolerance) {
+            kept[farthest] = true;
+            ranges.append({first, farthest});
+            ranges.append({farthest, last});
+        }
+    }
+    return kept;
+}
+
+// The curve fitting follows Philip J. Schneider's "An Algorithm for Automatically Fitting
+// Digitized Curves" from Graphics Gems. Tangents point away from the end they belong to.
+class CurveFitter
+{
+public:
+    CurveFitter(const Points &points, qreal squaredTolerance, QPainterPath &result)
+        : m_points(points)
+        , m_squaredTolerance(squaredTolerance)
+        , m_result(result)
+    {
+    }
+
+    // The tangent at `index` pointing towards the next point.
+    QPointF startTangent(qsizetype index) const
+    {
+        return unit(m_points[index + 1] - m_points[index]);
+    }
+
+    // The tangent at `index` pointing towards the previous point.
+    QPointF endTangent(qsizetype index) const
+    {
+        return unit(m_points[index - 1] - m_points[index]);
+    }
+
+    // The tangent at `index` pointing back, averaged over both of its neighbours.
+    QPointF centerTangent(qsizetype index) const
+    {
+        return unit(m_points[index - 1] - m_points[index + 1]);
+    }
+
+    bool isCorner(qsizetype index) const
+    {
+        return dot(-endTangent(index), startTangent(index)) < cornerCosine;
+    }
+
+    void fit(qsizetype first, qsizetype last, const QPointF &tangent1, const QPointF &tangent2)
+    {
+        const auto &start = m_points[first];
+        const auto &end = m_points[last];
+        const auto chord = unit(end - start);
+        if (dot(tangent1, chord) > 0.9999 && dot(tangent2, -chord) > 0.9999 && isStraight(first, last)) {
+            m_result.lineTo(end);
+            return;
+        }
+        if (last - first == 1) {
+            const auto distance = std::sqrt(squaredLength(end - start)) / 3;
+            addCurve({start, start + tangent1 * distance, end + tangent2 * distance, end});
+            return;
+        }
+
+        auto parameters = chordLengthParameters(first, last);
+        auto bezier = generateBezier(first, last, parameters, tangent1, tangent2);
+        auto [maxError, splitIndex] = maxSquaredError(first, last, bezier, parameters);
+        if (maxError < m_squaredTolerance) {
+            addCurve(bezier);
+            return;
+        }
+        // Close enough that better parameters might be enough.
+        if (maxError < m_squaredTolerance * 4) {
+            for (int i = 0; i < maxReparameterizations; ++i) {
+                reparameterize(first, last, bezier, parameters);
+                bezier = generateBezier(first, last, parameters, tangent1, tangent2);
+                std::tie(maxError, splitIndex) = maxSquaredError(first, last, bezier, parameters);
+                if (maxError < m_squaredTolerance) {
+                    addCurve(bezier);
+                    return;
+                }
+            }
+        }
+
+        const auto center = centerTangent(splitIndex);
+        fit(first, splitIndex, tangent1, center);
+        fit(splitIndex, last, -center, tangent2);
+    }
+
+private:
+    void addCurve(const Bezier &bezier)
+    {
+        m_result.cubicTo(bezier[1], bezier[2], bezier[3]);
+    }
+
+    // Whether every point is close enough to the line between the first and last points.
+    bool isStraight(qsizetype first, qsizetype last) const
+    {
+        for (auto i = first + 1; i < last; ++i) {
+            if (squaredDistanceToSegment(m_points[i], m_points[first], m_points[last]) > m_squaredTolerance) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    QList<qreal> chordLengthParameters(qsizetype first, qsizetype last) const
+    {
+        QList<qreal> parameters(last - first + 1);
+        parameters[0] = 0;
+        for (auto i = first + 1; i <= last; ++i) {
+            parameters[i - first] = parameters[i - first - 1] + std::sqrt(squaredLength(m_points[i] - m_points[i - 1]));
+        }
+        const auto total = parameters.constLast();
+        for (auto &parameter : parameters) {
+            parameter /= total;
+        }
+        return parameters;
+    }
+
+    // The control points along the tangents that fit the points best by least squares.
+    Bezier generateBezier(qsizetype first, qsizetype last, const QList<qreal> &parameters, const QPointF &tangent1, const QPointF &tangent2) const
+    {
+        const auto &start = m_points[first];
+        const auto &end = m_points[last];
+        qreal c00 = 0;
+        qreal c01 = 0;
+        qreal c11 = 0;
+        qreal x0 = 0;
+        qreal x1 = 0;
+        for (auto i = first; i <= last; ++i) {
+            const auto t = parameters[i - first];
+            const auto s = 1 - t;
+            const auto b0 = s * s * s;
+            const auto b1 = 3 * s * s * t;
+            const auto b2 = 3 * s * t * t;
+            const auto b3 = t * t * t;
+            const auto a1 = tangent1 * b1;
+            const auto a2 = tangent2 * b2;
+            c00 += dot(a1, a1);
+            c01 += dot(a1, a2);
+            c11 += dot(a2, a2);
+            const auto difference = m_points[i] - (start * (b0 + b1) + end * (b2 + b3));
+            x0 += dot(a1, difference);
+            x1 += dot(a2, difference);
+        }
+        const auto determinant = c00 * c11 - c01 * c01;
+        qreal alpha1 = determinant == 0 ? 0 : (x0 * c11 - x1 * c01) / determinant;
+        qreal alpha2 = determinant == 0 ? 0 : (c00 * x1 - c01 * x0) / determinant;
+        const auto chordLength = std::sqrt(squaredLength(end - start));
+        // Control points on the wrong side or on top of the end points,
+        // fall back to the heuristic from the paper.
+        if (alpha1 < chordLength * 1e-6 || alpha2 < chordLength * 1e-6) {
+            alpha1 = alpha2 = chordLength / 3;
+        }
+        return {start, start + tangent1 * alpha1, end + tangent2 * alpha2, end};
+    }
+
+    // The largest squared distance between a point and where the curve is at its parameter,
+    // and the index of that point. The index is never the first or last one.
+    std::pair<qreal, qsizetype> maxSquaredError(qsizetype first, qsizetype last, const Bezier &bezier, const QList<qreal> &parameters) const
+    {
+        qreal maxError = 0;
+        auto splitIndex = (first + last + 1) / 2;
+        for (auto i = first + 1; i < last; ++i) {
+            const auto error = squaredLength(bezierPoint(bezier, parameters[i - first]) - m_points[i]);
+            if (error >= maxError) {
+                maxError = error;
+                splitIndex = i;
+            }
+        }
+        return {maxError, splitIndex};
+    }
+
+    // Move each parameter closer to the nearest point of the curve with Newton-Raphson.
+    void reparameterize(qsizetype first, qsizetype last, const Bezier &bezier, QList<qreal> &parameters) const
+    {
+        for (auto i = first; i <= last; ++i) {
+            auto &t = parameters[i - first];
+            const auto difference = bezierPoint(bezier, t) - m_points[i];
+            const auto derivative = bezierDerivative(bezier, t);
+            const auto denominator = squaredLength(derivative) + dot(difference, bezierSecondDerivative(bezier, t));
+            if (denominator != 0) {
+                t = std::clamp(t - dot(difference, derivative) / denominator, 0.0, 1.0);
+            }
+        }
+    }
+
+    const Points &m_points;
+    const qreal m_squaredTolerance;
+    QPainterPath &m_result;
+};
+
+QPainterPath PathSimplification::simplified(const QPainterPath &path, qreal tolerance)
+{
+    if (path.elementCount() < 3 || tolerance <= 0) {
+        return path;
+    }
+    const auto squaredTolerance = tolerance * tolerance;
+    QPainterPath result;
+    result.setFillRule(path.fillRule());
+    for (const auto &points : subpathPoints(path)) {
+        result.moveTo(points.first());
+        if (points.size() < 2) {
+            // A click without moving is still a dot. A path with only a move is empty and isn't painted.
+            result.lineTo(points.first());
+            continue;
+        }
+        const auto kept = decimate(points, squaredTolerance);
+        CurveFitter fitter(points, squaredTolerance, result);
+        qsizetype first = 0;
+        auto tangent1 = fitter.startTangent(0);
+        for (qsizetype last = 1; last < points.size(); ++last) {
+            if (!kept[last]) {
+                continue;
+            }
+            const bool isEnd = last == points.size() - 1;
+            const bool isCorner = isEnd || fitter.isCorner(last);
+            const auto tangent2 = isCorner ? fitter.endTangent(last) : fitter.centerTangent(last);
+            fitter.fit(first, last, tangent1, tangent2);
+            if (!isEnd) {
+                tangent1 = isCorner ? fitter.startTangent(last) : -tangent2;
+            }
+            first = last;
+        }
+    }
+    if (result.elementCount() >= path.elementCount()) {
+        return path;
+    }
+    return result;
+}
@@ -0,0 +1,17 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#pragma once
+
+#include <QPainterPath>
+
+namespace PathSimplification
+{
+// `path` with fewer elements, for paths made of many short segments like freehand strokes.
+// The points ending the elements of every subpath are decimated with the Ramer–Douglas–Peucker
+// algorithm, then the points between the ones that are kept are fitted with cubic Bézier curves.
+// None of those points end up further than `tolerance` from the new path.
+// Sharp corners stay sharp, and straight segments between corners stay lines.
+// Returns `path` if the result wouldn't have fewer elements.
+QPainterPath simplified(const QPainterPath &path, qreal tolerance);
+}
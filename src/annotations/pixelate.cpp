@@ -0,0 +1,226 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#include "pixelate.h"
+#include "parallel_p.h"
+
+#include <QFloat16>
+#include <QImage>
+
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(Q_PROCESSOR_X86_64)
+#include <emmintrin.h>
+#define PIXELATE_HAVE_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PIXELATE_HAVE_NEON
+#endif
+
+// Adds `count` channel values of a row to the sums of their columns.
+template<typename T, typename Sum>
+static void addRow(Sum *sums, const T *row, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        sums[i] += Sum(row[i]);
+    }
+}
+
+// 8-bit channels are widened to 32-bit sums 16 at a time. SSE2 and NEON are part of
+// the baseline of the architectures that have them, so no runtime detection is needed.
+template<>
+void addRow(quint32 *sums, const quint8 *row, int count)
+{
+    int i = 0;
+#if defined(PIXELATE_HAVE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    auto add = [sums, zero](int i, __m128i words) {
+        auto sum = reinterpret_cast<__m128i *>(sums + i);
+        _mm_storeu_si128(sum, _mm_add_epi32(_mm_loadu_si128(sum), _mm_unpacklo_epi16(words, zero)));
+        _mm_storeu_si128(sum + 1, _mm_add_epi32(_mm_loadu_si128(sum + 1), _mm_unpackhi_epi16(words, zero)));
+    };
+    for (; i + 16 <= count; i += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+        add(i, _mm_unpacklo_epi8(bytes, zero));
+        add(i + 8, _mm_unpackhi_epi8(bytes, zero));
+    }
+#elif defined(PIXELATE_HAVE_NEON)
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16_t bytes = vld1q_u8(row + i);
+        const uint16x8_t low = vmovl_u8(vget_low_u8(bytes));
+        const uint16x8_t high = vmovl_u8(vget_high_u8(bytes));
+        vst1q_u32(sums + i, vaddw_u16(vld1q_u32(sums + i), vget_low_u16(low)));
+        vst1q_u32(sums + i + 4, vaddw_u16(vld1q_u32(sums + i + 4), vget_high_u16(low)));
+        vst1q_u32(sums + i + 8, vaddw_u16(vld1q_u32(sums + i + 8), vget_low_u16(high)));
+        vst1q_u32(sums + i + 12, vaddw_u16(vld1q_u32(sums + i + 12), vget_high_u16(high)));
+    }
+#endif
+    for (; i < count; ++i) {
+        sums[i] += row[i];
+    }
+}
+
+// Pixelates `target` of `image` into `result`, which has the size of `target`, for pixels with
+// `channels` values of type T. `source` is `target` extended to whole blocks and clipped to the image.
+template<typename T, int channels>
+static void pixelateBlocks(const QImage &image, const QRect &source, const QRect &target, int blockSize, QImage &result, int maxThreads)
+{
+    // The sums of a column within a block row, and the sums of a whole block.
+    // Integer sums are exact, floating point sums are doubles to not lose precision.
+    using ColumnSum = std::conditional_t<std::is_integral_v<T>, quint32, double>;
+    using BlockSum = std::conditional_t<std::is_integral_v<T>, quint64, double>;
+    const int width = source.width() * channels;
+    const int blockRows = (source.height() + blockSize - 1) / blockSize;
+    const int blocksPerRow = (source.width() + blockSize - 1) / blockSize;
+    // Taken up front, so the threads don't detach the images.
+    const uchar *bits = image.constBits();
+    const qsizetype stride = image.bytesPerLine();
+    uchar *resultBits = result.bits();
+    const qsizetype resultStride = result.bytesPerLine();
+
+    // Block rows don't share any pixels, so they can be pixelated in parallel.
+    Parallel::forEachBand(blockRows, 1, maxThreads, [&](int first, int count) {
+        std::vector<ColumnSum> columnSums(width);
+        std::vector<T> averages(blocksPerRow * channels);
+        for (int blockRow = first; blockRow < first + count; ++blockRow) {
+            const int top = source.top() + blockRow * blockSize;
+            const int bottom = std::min(top + blockSize, source.bottom() + 1);
+            std::fill(columnSums.begin(), columnSums.end(), ColumnSum(0));
+            for (int y = top; y < bottom; ++y) {
+                auto row = reinterpret_cast<const T *>(bits + y * stride) + source.left() * channels;
+                addRow(columnSums.data(), row, width);
+            }
+
+            for (int block = 0; block < blocksPerRow; ++block) {
+                const int left = block * blockSize;
+                const int right = std::min(left + blockSize, source.width());
+                BlockSum sums[channels] = {};
+                for (int x = left; x < right; ++x) {
+                    for (int c = 0; c < channels; ++c) {
+                        sums[c] += columnSums[x * channels + c];
+                    }
+                }
+                const BlockSum pixels = BlockSum(right - left) * (bottom - top);
+                for (int c = 0; c < channels; ++c) {
+                    if constexpr (std::is_integral_v<T>) {
+                        averages[block * channels + c] = T((sums[c] + pixels / 2) / pixels);
+                    } else {
+                        averages[block * channels + c] = T(float(sums[c] / pixels));
+                    }
+                }
+            }
+
+            // Only the part of the block row inside the target is written.
+            for (int y = std::max(top, target.top()); y < std::min(bottom, target.bottom() + 1); ++y) {
+                auto row = reinterpret_cast<T *>(resultBits + (y - target.top()) * resultStride);
+                for (int x = target.left(); x <= target.right();) {
+                    const int block = (x - source.left()) / blockSize;
+                    const int right = std::min(source.left() + (block + 1) * blockSize, target.right() + 1);
+                    const T *average = averages.data() + block * channels;
+                    for (; x < right; ++x) {
+                        std::copy(average, average + channels, row + (x - target.left()) * channels);
+                    }
+                }
+            }
+        }
+    });
+}
+
+// The format to pixelate an image in if it can't be pixelated in its own format.
+static QImage::Format pixelateFormat(const QImage &image)
+{
+    switch (image.format()) {
+    case QImage::Format_ARGB32:
+        return QImage::Format_ARGB32_Premultiplied;
+    case QImage::Format_RGBA8888:
+        return QImage::Format_RGBA8888_Premultiplied;
+    case QImage::Format_RGBA64:
+        return QImage::Format_RGBA64_Premultiplied;
+    case QImage::Format_RGBA16FPx4:
+        return QImage::Format_RGBA16FPx4_Premultiplied;
+    case QImage::Format_RGBA32FPx4:
+        return QImage::Format_RGBA32FPx4_Premultiplied;
+    default:
+        break;
+    }
+    const bool alpha = image.hasAlphaChannel();
+    const auto pixelFormat = image.pixelFormat();
+    if (pixelFormat.typeInterpretation() == QPixelFormat::FloatingPoint) {
+        return alpha ? QImage::Format_RGBA32FPx4_Premultiplied : QImage::Format_RGBX32FPx4;
+    }
+    const int maxChannelSize = std::max({pixelFormat.redSize(), pixelFormat.greenSize(), pixelFormat.blueSize(), pixelFormat.alphaSize()});
+    if (maxChannelSize > 8) {
+        return alpha ? QImage::Format_RGBA64_Premultiplied : QImage::Format_RGBX64;
+    }
+    return alpha ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+}
+
+QRect Pixelation::blockAlignedRect(const QRect &rect, int blockSize)
+{
+    blockSize = std::max(blockSize, 1);
+    auto floor = [blockSize](int value) {
+        return value >= 0 ? value / blockSize * blockSize : (value - blockSize + 1) / blockSize * blockSize;
+    };
+    const int left = floor(rect.left());
+    const int top = floor(rect.top());
+    const int right = floor(rect.right()) + blockSize;
+    const int bottom = floor(rect.bottom()) + blockSize;
+    return QRect{QPoint{left, top}, QPoint{right - 1, bottom - 1}};
+}
+
+QImage Pixelation::pixelated(const QImage &image, const QRect &rect, int blockSize, int maxThreads)
+{
+    const QRect target = rect.intersected(image.rect());
+    if (image.isNull() || target.isEmpty()) {
+        return {};
+    }
+    if (blockSize <= 1) {
+        return image.copy(target);
+    }
+    const QRect source = blockAlignedRect(target, blockSize).intersected(image.rect());
+    QImage result(target.size(), image.format());
+    switch (image.format()) {
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGBA8888_Premultiplied:
+        pixelateBlocks<quint8, 4>(image, source, target, blockSize, result, maxThreads);
+        return result;
+    case QImage::Format_Alpha8:
+    case QImage::Format_Grayscale8:
+        pixelateBlocks<quint8, 1>(image, source, target, blockSize, result, maxThreads);
+        return result;
+    case QImage::Format_Grayscale16:
+        pixelateBlocks<quint16, 1>(image, source, target, blockSize, result, maxThreads);
+        return result;
+    case QImage::Format_RGBX64:
+    case QImage::Format_RGBA64_Premultiplied:
+        pixelateBlocks<quint16, 4>(image, source, target, blockSize, result, maxThreads);
+        return result;
+    case QImage::Format_RGBX16FPx4:
+    case QImage::Format_RGBA16FPx4_Premultiplied:
+        pixelateBlocks<qfloat16, 4>(image, source, target, blockSize, result, maxThreads);
+        return result;
+    case QImage::Format_RGBX32FPx4:
+    case QImage::Format_RGBA32FPx4_Premultiplied:
+        pixelateBlocks<float, 4>(image, source, target, blockSize, result, maxThreads);
+        return result;
+    default:
+        break;
+    }
+
+    // Only convert the pixels that are read. The part starts at a block boundary,
+    // so its blocks are the same as those of the image.
+    const auto part = image.copy(source).convertToFormat(pixelateFormat(image));
+    return pixelated(part, target.translated(-source.topLeft()), blockSize, maxThreads).convertToFormat(image.format());
+}
+
+void Pixelation::pixelate(QImage &image, int blockSize, int maxThreads)
+{
+    if (image.isNull() || blockSize <= 1) {
+        return;
+    }
+    image = pixelated(image, image.rect(), blockSize, maxThreads);
+}
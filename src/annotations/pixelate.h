@@ -0,0 +1,29 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#pragma once
+
+#include <QRect>
+
+class QImage;
+
+namespace Pixelation
+{
+// Replace every block of `blockSize` x `blockSize` pixels with the average of its pixels.
+// Blocks are on a grid starting at the top left corner of the image, so the blocks at the
+// right and bottom edges can be smaller.
+// Images with premultiplied or no alpha are pixelated in their own format, so 16-bit
+// and floating point channels keep their precision. Other formats are pixelated
+// in a copy with a format that doesn't lose precision and converted back.
+// Block rows are pixelated on up to `maxThreads` threads of QThreadPool::globalInstance(),
+// including the calling thread. 0 means as many threads as the pool allows.
+void pixelate(QImage &image, int blockSize, int maxThreads = 0);
+
+// Only the pixels of `rect` inside the image, pixelated like pixelate() would.
+// Blocks on the edge of `rect` are still averaged over all of their pixels, so neighbouring
+// rects line up. Only the blocks overlapping `rect` are read.
+QImage pixelated(const QImage &image, const QRect &rect, int blockSize, int maxThreads = 0);
+
+// `rect` extended to the edges of the blocks it overlaps.
+QRect blockAlignedRect(const QRect &rect, int blockSize);
+}
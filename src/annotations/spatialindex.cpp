@@ -0,0 +1,137 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#include "spatialindex.h"
+
+#include <QtMath>
+
+#include <algorithm>
+
+// Unlike QRectF::intersects(), rects that only share an edge and empty rects count.
+static bool touches(const QRectF &a, const QRectF &b)
+{
+    return a.left() <= b.right() && b.left() <= a.right() //
+        && a.top() <= b.bottom() && b.top() <= a.bottom();
+}
+
+SpatialIndex::SpatialIndex(qreal cellSize)
+    : m_cellSize(cellSize)
+{
+}
+
+QRect SpatialIndex::cells(const QRectF &rect) const
+{
+    return QRect{QPoint{qFloor(rect.left() / m_cellSize), qFloor(rect.top() / m_cellSize)},
+                 QPoint{qFloor(rect.right() / m_cellSize), qFloor(rect.bottom() / m_cellSize)}};
+}
+
+bool SpatialIndex::isLarge(const QRect &cells) const
+{
+    return qsizetype(cells.width()) * cells.height() > maxCellsPerRect;
+}
+
+void SpatialIndex::insert(qsizetype position, const QRectF &rect)
+{
+    remove(position);
+    const auto normalized = rect.normalized();
+    m_rects.insert(position, normalized);
+    const auto cells = this->cells(normalized);
+    if (isLarge(cells)) {
+        m_large.append(position);
+        return;
+    }
+    for (int y = cells.top(); y <= cells.bottom(); ++y) {
+        for (int x = cells.left(); x <= cells.right(); ++x) {
+            m_cells[{x, y}].append(position);
+        }
+    }
+}
+
+void SpatialIndex::remove(qsizetype position)
+{
+    const auto it = m_rects.constFind(position);
+    if (it == m_rects.cend()) {
+        return;
+    }
+    const auto cells = this->cells(*it);
+    m_rects.erase(it);
+    if (isLarge(cells)) {
+        m_large.removeOne(position);
+        return;
+    }
+    for (int y = cells.top(); y <= cells.bottom(); ++y) {
+        for (int x = cells.left(); x <= cells.right(); ++x) {
+            auto cell = m_cells.find({x, y});
+            cell->removeOne(position);
+            if (cell->isEmpty()) {
+                m_cells.erase(cell);
+            }
+        }
+    }
+}
+
+void SpatialIndex::clear()
+{
+    m_rects.clear();
+    m_cells.clear();
+    m_large.clear();
+}
+
+bool SpatialIndex::contains(qsizetype position) const
+{
+    return m_rects.contains(position);
+}
+
+QRectF SpatialIndex::rect(qsizetype position) const
+{
+    return m_rects.value(position);
+}
+
+qsizetype SpatialIndex::size() const
+{
+    return m_rects.size();
+}
+
+QList<qsizetype> SpatialIndex::intersecting(const QRectF &rect) const
+{
+    QList<qsizetype> positions;
+    if (m_rects.isEmpty()) {
+        return positions;
+    }
+    const auto normalized = rect.normalized();
+    const auto cells = this->cells(normalized);
+    if (isLarge(cells) || qsizetype(cells.width()) * cells.height() > m_rects.size()) {
+        // Checking every rect is cheaper than visiting every cell.
+        for (auto it = m_rects.cbegin(); it != m_rects.cend(); ++it) {
+            if (touches(*it, normalized)) {
+                positions.append(it.key());
+            }
+        }
+        std::ranges::sort(positions);
+        return positions;
+    }
+    auto addTouching = [&](const QList<qsizetype> &candidates) {
+        for (auto position : candidates) {
+            if (touches(m_rects.value(position), normalized)) {
+                positions.append(position);
+            }
+        }
+    };
+    for (int y = cells.top(); y <= cells.bottom(); ++y) {
+        for (int x = cells.left(); x <= cells.right(); ++x) {
+            if (auto cell = m_cells.constFind({x, y}); cell != m_cells.cend()) {
+                addTouching(*cell);
+            }
+        }
+    }
+    addTouching(m_large);
+    // Rects in more than one cell are found more than once.
+    std::ranges::sort(positions);
+    positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+    return positions;
+}
+
+QList<qsizetype> SpatialIndex::containing(const QPointF &point) const
+{
+    return intersecting(QRectF{point, QSizeF{0, 0}});
+}
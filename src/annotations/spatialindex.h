@@ -0,0 +1,55 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QPoint>
+#include <QRectF>
+
+/**
+ * A uniform grid of rects, for finding the rects near a point or another rect without
+ * checking all of them.
+ *
+ * Each rect is stored at a position, such as the index of an item in a list. Queries return
+ * positions in ascending order, so the results can be used in the order of the list.
+ *
+ * Queries return every rect touching the query, so they can have a few more results than
+ * an exact test. Callers should still test the shapes they find.
+ */
+class SpatialIndex
+{
+public:
+    static constexpr qreal defaultCellSize = 256;
+
+    explicit SpatialIndex(qreal cellSize = defaultCellSize);
+
+    // Add a rect at the position or replace the one there.
+    void insert(qsizetype position, const QRectF &rect);
+    void remove(qsizetype position);
+    void clear();
+
+    bool contains(qsizetype position) const;
+    // The rect at the position or a null rect if there isn't one.
+    QRectF rect(qsizetype position) const;
+    qsizetype size() const;
+
+    // The positions of the rects touching `rect`.
+    QList<qsizetype> intersecting(const QRectF &rect) const;
+    // The positions of the rects containing `point`, including on their edges.
+    QList<qsizetype> containing(const QPointF &point) const;
+
+private:
+    // The columns and rows of the cells `rect` touches.
+    QRect cells(const QRectF &rect) const;
+    // Rects touching too many cells are checked by every query instead.
+    bool isLarge(const QRect &cells) const;
+
+    static constexpr qsizetype maxCellsPerRect = 1024;
+
+    qreal m_cellSize;
+    QHash<qsizetype, QRectF> m_rects;
+    QHash<QPoint, QList<qsizetype>> m_cells;
+    QList<qsizetype> m_large;
+};
@@ -8,13 +8,24 @@
 //
 // SPDX-License-Identifier: BSD-2-Clause
 
-#include "stackblur.h"
+#include "stackblur_p.h"
+#include "parallel_p.h"
 
 #include <QPainter>
 #include <QImage>
+#include <QByteArray>
 #include <QColor>
+#include <QDebug>
+#include <QFloat16>
+#include <QRect>
 
-static unsigned short const mulTable[255] = {
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <type_traits>
+
+const unsigned short StackBlur::mulTable[maxRadius + 1] = {
     512, 512, 456, 512, 328, 456, 335, 512, 405, 328, 271, 456, 388, 335, 292, 512, 454, 405, 364, 328, 298, 271, 496, 456, 420, 388, 360, 335, 312,
     292, 273, 512, 482, 454, 428, 405, 383, 364, 345, 328, 312, 298, 284, 271, 259, 496, 475, 456, 437, 420, 404, 388, 374, 360, 347, 335, 323, 312,
     302, 292, 282, 273, 265, 512, 497, 482, 468, 454, 441, 428, 417, 405, 394, 383, 373, 364, 354, 345, 337, 328, 320, 312, 305, 298, 291, 284, 278,
@@ -25,7 +36,7 @@ static unsigned short const mulTable[255] = {
     404, 400, 396, 392, 388, 385, 381, 377, 374, 370, 367, 363, 360, 357, 354, 350, 347, 344, 341, 338, 335, 332, 329, 326, 323, 320, 318, 315, 312,
     310, 307, 304, 302, 299, 297, 294, 292, 289, 287, 285, 282, 280, 278, 275, 273, 271, 269, 267, 265, 263, 261, 259};
 
-static unsigned char const shgTable[255] = {
+const unsigned char StackBlur::shgTable[maxRadius + 1] = {
     9,  11, 12, 13, 13, 14, 14, 15, 15, 15, 15, 16, 16, 16, 16, 17, 17, 17, 17, 17, 17, 17, 18, 18, 18, 18, 18, 18, 18, 18, 18, 19, 19, 19, 19, 19, 19,
     19, 19, 19, 19, 19, 19, 19, 19, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21,
     21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
@@ -34,21 +45,88 @@ static unsigned char const shgTable[255] = {
     24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
     24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24};
 
-void StackBlur::blur(QImage &image, const QSize &kernelSize)
+// The premultiplied counterpart of a format with unpremultiplied alpha, otherwise the format itself.
+static QImage::Format premultipliedFormat(QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_ARGB32:
+        return QImage::Format_ARGB32_Premultiplied;
+    case QImage::Format_RGBA8888:
+        return QImage::Format_RGBA8888_Premultiplied;
+    case QImage::Format_RGBA64:
+        return QImage::Format_RGBA64_Premultiplied;
+    case QImage::Format_RGBA16FPx4:
+        return QImage::Format_RGBA16FPx4_Premultiplied;
+    case QImage::Format_RGBA32FPx4:
+        return QImage::Format_RGBA32FPx4_Premultiplied;
+    default:
+        return format;
+    }
+}
+
+// Copies the pixels of `fromRect` in `from` to `toPos` in `to`. Both images must have the same format.
+static void copyPixels(const QImage &from, const QRect &fromRect, QImage &to, const QPoint &toPos)
+{
+    const qsizetype bytesPerPixel = to.depth() / 8;
+    for (int y = 0; y < fromRect.height(); ++y) {
+        std::memcpy(to.scanLine(toPos.y() + y) + toPos.x() * bytesPerPixel,
+                    from.constScanLine(fromRect.top() + y) + fromRect.left() * bytesPerPixel,
+                    fromRect.width() * bytesPerPixel);
+    }
+}
+
+// Blurs a copy of the image converted to `blurFormat`, e.g. because blurring unpremultiplied
+// colors would bleed the colors of transparent pixels into their neighbours.
+// Returns false if the image already has that format and is fine to blur as is.
+static bool blurConverted(QImage &image,
+                          const QRect &roi,
+                          const QSize &kernelSize,
+                          QImage::Format blurFormat,
+                          const std::function<void(QImage &image, const QRect &roi)> &blur)
+{
+    const auto format = image.format();
+    if (blurFormat == format) {
+        return false;
+    }
+    if (roi == image.rect()) {
+        image.convertTo(blurFormat);
+        blur(image, roi);
+        image.convertTo(format);
+        return true;
+    }
+
+    // Only convert the pixels that are read, so that the pixels outside of the ROI
+    // don't lose precision by being converted and converted back again.
+    const QRect source = StackBlur::sourceRect(roi, kernelSize).intersected(image.rect());
+    const QRect partRoi = roi.translated(-source.topLeft());
+    auto part = image.copy(source).convertToFormat(blurFormat);
+    blur(part, partRoi);
+    part.convertTo(format);
+    copyPixels(part, partRoi, image, roi.topLeft());
+    return true;
+}
+
+void StackBlur::referenceBlur(QImage &image, const QSize &kernelSize)
 {
     if (kernelSize.width() == 1 && kernelSize.height() == 1) {
         return;
     }
+    if (blurConverted(image, image.rect(), kernelSize, premultipliedFormat(image.format()), [&kernelSize](QImage &image, const QRect &) {
+            referenceBlur(image, kernelSize);
+        })) {
+        return;
+    }
 
-    const int radiusX = kernelSize.width();
-    const int radiusY = kernelSize.height();
+    // Larger radii would read past the end of the tables.
+    const int radiusX = std::min(kernelRadius(kernelSize.width()), maxRadius);
+    const int radiusY = std::min(kernelRadius(kernelSize.height()), maxRadius);
     const int w = image.width();
     const int h = image.height();
 
     const int wm = w - 1;
     const int hm = h - 1;
 
-    std::vector<int> r(w * h), g(w * h), b(w * h);
+    std::vector<int> r(w * h), g(w * h), b(w * h), a(w * h);
     std::vector<int> vmin(std::max(w, h));
 
     // Horizontal pass with radiusX
@@ -58,13 +136,13 @@ void StackBlur::blur(QImage &image, const QSize &kernelSize)
         divsumX *= divsumX;
 
         struct Pixel {
-            int r, g, b;
+            int r, g, b, a;
         };
         std::vector<Pixel> stack(divX);
 
         for (int y = 0; y < h; y++) {
-            int rinsum = 0, ginsum = 0, binsum = 0, routsum = 0, goutsum = 0, boutsum = 0;
-            int rsum = 0, gsum = 0, bsum = 0;
+            int rinsum = 0, ginsum = 0, binsum = 0, ainsum = 0, routsum = 0, goutsum = 0, boutsum = 0, aoutsum = 0;
+            int rsum = 0, gsum = 0, bsum = 0, asum = 0;
             int yi = y * w;
 
             for (int i = -radiusX; i <= radiusX; i++) {
@@ -74,32 +152,38 @@ void StackBlur::blur(QImage &image, const QSize &kernelSize)
                 sir.r = qRed(p);
                 sir.g = qGreen(p);
                 sir.b = qBlue(p);
+                sir.a = qAlpha(p);
 
                 int rbs = radiusX + 1 - abs(i);
                 rsum += sir.r * rbs;
                 gsum += sir.g * rbs;
                 bsum += sir.b * rbs;
+                asum += sir.a * rbs;
 
                 if (i > 0) {
                     rinsum += sir.r;
                     ginsum += sir.g;
                     binsum += sir.b;
+                    ainsum += sir.a;
                 } else {
                     routsum += sir.r;
                     goutsum += sir.g;
                     boutsum += sir.b;
+                    aoutsum += sir.a;
                 }
             }
 
             int stackpointer = radiusX;
             for (int x = 0; x < w; x++) {
-                r[yi] = (rsum * mulTable[radiusX]) >> shgTable[radiusX];
-                g[yi] = (gsum * mulTable[radiusX]) >> shgTable[radiusX];
-                b[yi] = (bsum * mulTable[radiusX]) >> shgTable[radiusX];
+                r[yi] = (quint32(rsum) * mulTable[radiusX]) >> shgTable[radiusX];
+                g[yi] = (quint32(gsum) * mulTable[radiusX]) >> shgTable[radiusX];
+                b[yi] = (quint32(bsum) * mulTable[radiusX]) >> shgTable[radiusX];
+                a[yi] = (quint32(asum) * mulTable[radiusX]) >> shgTable[radiusX];
 
                 rsum -= routsum;
                 gsum -= goutsum;
                 bsum -= boutsum;
+                asum -= aoutsum;
 
                 int stackstart = (stackpointer - radiusX + divX) % divX;
                 Pixel &sir = stack[stackstart];
@@ -107,6 +191,7 @@ void StackBlur::blur(QImage &image, const QSize &kernelSize)
                 routsum -= sir.r;
                 goutsum -= sir.g;
                 boutsum -= sir.b;
+                aoutsum -= sir.a;
 
                 if (y == 0)
                     vmin[x] = std::clamp(x + radiusX + 1, 0, wm);
@@ -115,13 +200,16 @@ void StackBlur::blur(QImage &image, const QSize &kernelSize)
                 sir.r = qRed(p);
                 sir.g = qGreen(p);
                 sir.b = qBlue(p);
+                sir.a = qAlpha(p);
 
                 rinsum += sir.r;
                 ginsum += sir.g;
                 binsum += sir.b;
+                ainsum += sir.a;
                 rsum += rinsum;
                 gsum += ginsum;
                 bsum += binsum;
+                asum += ainsum;
 
                 stackpointer = (stackpointer + 1) % divX;
 
@@ -129,15 +217,17 @@ void StackBlur::blur(QImage &image, const QSize &kernelSize)
                 routsum += sir2.r;
                 goutsum += sir2.g;
                 boutsum += sir2.b;
+                aoutsum += sir2.a;
                 rinsum -= sir2.r;
                 ginsum -= sir2.g;
                 binsum -= sir2.b;
+                ainsum -= sir2.a;
 
                 yi++;
             }
         }
     } else {
-        // If radiusX==0, copy the image to r/g/b
+        // If radiusX==0, copy the image to r/g/b/a
         for (int y = 0; y < h; ++y) {
             int yi = y * w;
             for (int x = 0; x < w; ++x, ++yi) {
@@ -145,6 +235,7 @@ void StackBlur::blur(QImage &image, const QSize &kernelSize)
                 r[yi] = qRed(p);
                 g[yi] = qGreen(p);
                 b[yi] = qBlue(p);
+                a[yi] = qAlpha(p);
             }
         }
     }
@@ -156,13 +247,13 @@ void StackBlur::blur(QImage &image, const QSize &kernelSize)
         divsumY *= divsumY;
 
         struct Pixel {
-            int r, g, b;
+            int r, g, b, a;
         };
         std::vector<Pixel> stack(divY);
 
         for (int x = 0; x < w; x++) {
-            int rinsum = 0, ginsum = 0, binsum = 0, routsum = 0, goutsum = 0, boutsum = 0;
-            int rsum = 0, gsum = 0, bsum = 0;
+            int rinsum = 0, ginsum = 0, binsum = 0, ainsum = 0, routsum = 0, goutsum = 0, boutsum = 0, aoutsum = 0;
+            int rsum = 0, gsum = 0, bsum = 0, asum = 0;
             int yi = x;
 
             for (int i = -radiusY; i <= radiusY; i++) {
@@ -172,19 +263,23 @@ void StackBlur::blur(QImage &image, const QSize &kernelSize)
                 sir.r = r[p];
                 sir.g = g[p];
                 sir.b = b[p];
+                sir.a = a[p];
                 int rbs = radiusY + 1 - abs(i);
                 rsum += r[p] * rbs;
                 gsum += g[p] * rbs;
                 bsum += b[p] * rbs;
+                asum += a[p] * rbs;
 
                 if (i > 0) {
                     rinsum += sir.r;
                     ginsum += sir.g;
                     binsum += sir.b;
+                    ainsum += sir.a;
                 } else {
                     routsum += sir.r;
                     goutsum += sir.g;
                     boutsum += sir.b;
+                    aoutsum += sir.a;
                 }
             }
 
@@ -192,19 +287,22 @@ void StackBlur::blur(QImage &image, const QSize &kernelSize)
             for (int y = 0; y < h; y++) {
                 image.setPixel(x,
                                y,
-                               qRgb((rsum * mulTable[radiusY]) >> shgTable[radiusY],
-                                    (gsum * mulTable[radiusY]) >> shgTable[radiusY],
-                                    (bsum * mulTable[radiusY]) >> shgTable[radiusY]));
+                               qRgba((quint32(rsum) * mulTable[radiusY]) >> shgTable[radiusY],
+                                     (quint32(gsum) * mulTable[radiusY]) >> shgTable[radiusY],
+                                     (quint32(bsum) * mulTable[radiusY]) >> shgTable[radiusY],
+                                     (quint32(asum) * mulTable[radiusY]) >> shgTable[radiusY]));
 
                 rsum -= routsum;
                 gsum -= goutsum;
                 bsum -= boutsum;
+                asum -= aoutsum;
 
                 int stackstart = (stackpointer - radiusY + divY) % divY;
                 Pixel &sir = stack[stackstart];
                 routsum -= sir.r;
                 goutsum -= sir.g;
                 boutsum -= sir.b;
+                aoutsum -= sir.a;
 
                 if (x == 0)
                     vmin[y] = std::clamp(y + radiusY + 1, 0, hm) * w;
@@ -213,13 +311,16 @@ void StackBlur::blur(QImage &image, const QSize &kernelSize)
                 sir.r = r[p];
                 sir.g = g[p];
                 sir.b = b[p];
+                sir.a = a[p];
 
                 rinsum += sir.r;
                 ginsum += sir.g;
                 binsum += sir.b;
+                ainsum += sir.a;
                 rsum += rinsum;
                 gsum += ginsum;
                 bsum += binsum;
+                asum += ainsum;
 
                 stackpointer = (stackpointer + 1) % divY;
 
@@ -227,12 +328,708 @@ void StackBlur::blur(QImage &image, const QSize &kernelSize)
                 routsum += sir2.r;
                 goutsum += sir2.g;
                 boutsum += sir2.b;
+                aoutsum += sir2.a;
                 rinsum -= sir2.r;
                 ginsum -= sir2.g;
                 binsum -= sir2.b;
+                ainsum -= sir2.a;
 
                 yi += w;
             }
         }
+    } else {
+        // If radiusY==0, copy r/g/b/a back to the image
+        for (int y = 0; y < h; ++y) {
+            int yi = y * w;
+            for (int x = 0; x < w; ++x, ++yi) {
+                image.setPixel(x, y, qRgba(r[yi], g[yi], b[yi], a[yi]));
+            }
+        }
+    }
+}
+
+// Scanline kernels
+
+template<int channels>
+static void scalarChannelLines(const StackBlur::Lines &lines, int radius)
+{
+    using namespace StackBlur;
+    const quint32 mul = mulTable[radius];
+    const quint32 shg = shgTable[radius];
+    const int last = lines.size - 1;
+    uchar orBytes[4];
+    std::memcpy(orBytes, &lines.orMask, 4);
+
+    for (int line = 0; line < lines.count; ++line) {
+        const uchar *src = lines.src + line * lines.srcLineStep;
+        uchar *dst = lines.dst + line * lines.dstLineStep;
+        // Unsigned so that intermediate underflows wrap around and cancel out.
+        quint32 sum[channels] = {};
+        quint32 sumIn[channels] = {};
+        quint32 sumOut[channels] = {};
+
+        for (int i = -radius; i <= radius; ++i) {
+            const uchar *p = src + clampedOffset(lines.begin + i, last, lines.srcPixelStep);
+            const quint32 weight = radius + 1 - std::abs(i);
+            auto &side = i > 0 ? sumIn : sumOut;
+            for (int c = 0; c < channels; ++c) {
+                sum[c] += p[c] * weight;
+                side[c] += p[c];
+            }
+        }
+
+        for (int x = lines.begin; x < lines.end; ++x) {
+            for (int c = 0; c < channels; ++c) {
+                dst[c] = uchar((sum[c] * mul) >> shg) | orBytes[c];
+            }
+            dst += lines.dstPixelStep;
+
+            const uchar *out = src + clampedOffset(x - radius, last, lines.srcPixelStep);
+            const uchar *in = src + clampedOffset(x + radius + 1, last, lines.srcPixelStep);
+            const uchar *next = src + clampedOffset(x + 1, last, lines.srcPixelStep);
+            for (int c = 0; c < channels; ++c) {
+                sum[c] -= sumOut[c];
+                sumOut[c] -= out[c];
+                sumIn[c] += in[c];
+                sum[c] += sumIn[c];
+                sumOut[c] += next[c];
+                sumIn[c] -= next[c];
+            }
+        }
+    }
+}
+
+void StackBlur::scalarLines(const Lines &lines, int radius)
+{
+    scalarChannelLines<4>(lines, radius);
+}
+
+void StackBlur::scalarAlphaLines(const Lines &lines, int radius)
+{
+    scalarChannelLines<1>(lines, radius);
+}
+
+void StackBlur::scalarColumns(const Lines &lines, int radius)
+{
+    Q_ASSERT(lines.srcLineStep == 4 && lines.dstLineStep == 4);
+    // The sums of all channels of a block, laid out like the pixels.
+    constexpr int channels = blockColumns * 4;
+    const quint32 mul = mulTable[radius];
+    const quint32 shg = shgTable[radius];
+    const int last = lines.size - 1;
+    uchar orBytes[4];
+    std::memcpy(orBytes, &lines.orMask, 4);
+
+    int column = 0;
+    for (; column + blockColumns <= lines.count; column += blockColumns) {
+        const uchar *src = lines.src + column * 4;
+        uchar *dst = lines.dst + column * 4;
+        quint32 sum[channels] = {};
+        quint32 sumIn[channels] = {};
+        quint32 sumOut[channels] = {};
+
+        for (int i = -radius; i <= radius; ++i) {
+            const uchar *p = src + clampedOffset(lines.begin + i, last, lines.srcPixelStep);
+            const quint32 weight = radius + 1 - std::abs(i);
+            auto &side = i > 0 ? sumIn : sumOut;
+            for (int c = 0; c < channels; ++c) {
+                sum[c] += p[c] * weight;
+                side[c] += p[c];
+            }
+        }
+
+        for (int y = lines.begin; y < lines.end; ++y) {
+            for (int c = 0; c < channels; ++c) {
+                dst[c] = uchar((sum[c] * mul) >> shg) | orBytes[c % 4];
+            }
+            dst += lines.dstPixelStep;
+
+            const uchar *out = src + clampedOffset(y - radius, last, lines.srcPixelStep);
+            const uchar *in = src + clampedOffset(y + radius + 1, last, lines.srcPixelStep);
+            const uchar *next = src + clampedOffset(y + 1, last, lines.srcPixelStep);
+            for (int c = 0; c < channels; ++c) {
+                sum[c] -= sumOut[c];
+                sumOut[c] -= out[c];
+                sumIn[c] += in[c];
+                sum[c] += sumIn[c];
+                sumOut[c] += next[c];
+                sumIn[c] -= next[c];
+            }
+        }
+    }
+
+    if (column < lines.count) {
+        scalarLines(lines.band(column, lines.count - column), radius);
+    }
+}
+
+template<typename T>
+static T fromSum(double value)
+{
+    if constexpr (std::is_integral_v<T>) {
+        return T(value + 0.5);
+    } else {
+        return T(float(value));
+    }
+}
+
+// Blurs lines of pixels with `channels` values of type T, for formats with 16-bit or floating point
+// channels, or blocks of neighbouring columns of those. The sums are doubles, which add up 16-bit
+// values exactly and keep floating point values from drifting, so the result is divided exactly
+// instead of being approximated with the tables.
+template<typename T, int channels>
+static void wideLines(const StackBlur::Lines &lines, int radius)
+{
+    using namespace StackBlur;
+    const double divisor = double(radius + 1) * (radius + 1);
+    const int last = lines.size - 1;
+    auto channel = [](const uchar *pixel, int c) {
+        return double(reinterpret_cast<const T *>(pixel)[c]);
+    };
+
+    for (int line = 0; line < lines.count; ++line) {
+        const uchar *src = lines.src + line * lines.srcLineStep;
+        uchar *dst = lines.dst + line * lines.dstLineStep;
+        double sum[channels] = {};
+        double sumIn[channels] = {};
+        double sumOut[channels] = {};
+
+        for (int i = -radius; i <= radius; ++i) {
+            const uchar *p = src + clampedOffset(lines.begin + i, last, lines.srcPixelStep);
+            const double weight = radius + 1 - std::abs(i);
+            auto &side = i > 0 ? sumIn : sumOut;
+            for (int c = 0; c < channels; ++c) {
+                sum[c] += channel(p, c) * weight;
+                side[c] += channel(p, c);
+            }
+        }
+
+        for (int x = lines.begin; x < lines.end; ++x) {
+            auto pixel = reinterpret_cast<T *>(dst);
+            for (int c = 0; c < channels; ++c) {
+                pixel[c] = fromSum<T>(sum[c] / divisor);
+            }
+            dst += lines.dstPixelStep;
+
+            const uchar *out = src + clampedOffset(x - radius, last, lines.srcPixelStep);
+            const uchar *in = src + clampedOffset(x + radius + 1, last, lines.srcPixelStep);
+            const uchar *next = src + clampedOffset(x + 1, last, lines.srcPixelStep);
+            for (int c = 0; c < channels; ++c) {
+                sum[c] -= sumOut[c];
+                sumOut[c] -= channel(out, c);
+                sumIn[c] += channel(in, c);
+                sum[c] += sumIn[c];
+                sumOut[c] += channel(next, c);
+                sumIn[c] -= channel(next, c);
+            }
+        }
+    }
+}
+
+// Whether the format has 8-bit channels that the scanline kernels can blur independently.
+static bool isScanlineFormat(QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGBA8888_Premultiplied:
+    case QImage::Format_Alpha8:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// The unused alpha channel of formats without alpha read as a native 32-bit integer.
+// It has to stay 0xff no matter what the image contains. Formats with alpha get it blurred.
+static quint32 opaqueMask(QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_RGB32:
+        return 0xff000000;
+    case QImage::Format_RGBX8888:
+        // Byte ordered formats always have alpha as the last byte.
+        return Q_BYTE_ORDER == Q_LITTLE_ENDIAN ? 0xff000000 : 0x000000ff;
+    default:
+        return 0;
+    }
+}
+
+// The format an image is blurred in by the kernels. Unpremultiplied colors get premultiplied,
+// and formats the kernels don't support are converted to one with at least as much precision.
+static QImage::Format kernelFormat(const QImage &image)
+{
+    const auto format = premultipliedFormat(image.format());
+    switch (format) {
+    case QImage::Format_RGBX64:
+    case QImage::Format_RGBA64_Premultiplied:
+    case QImage::Format_RGBX16FPx4:
+    case QImage::Format_RGBA16FPx4_Premultiplied:
+    case QImage::Format_RGBX32FPx4:
+    case QImage::Format_RGBA32FPx4_Premultiplied:
+        return format;
+    default:
+        break;
+    }
+    if (isScanlineFormat(format)) {
+        return format;
+    }
+
+    const bool alpha = image.hasAlphaChannel();
+    const auto pixelFormat = image.pixelFormat();
+    if (pixelFormat.typeInterpretation() == QPixelFormat::FloatingPoint) {
+        return alpha ? QImage::Format_RGBA32FPx4_Premultiplied : QImage::Format_RGBX32FPx4;
+    }
+    const int maxChannelSize = std::max({pixelFormat.redSize(), pixelFormat.greenSize(), pixelFormat.blueSize(), pixelFormat.alphaSize()});
+    if (maxChannelSize > 8) {
+        return alpha ? QImage::Format_RGBA64_Premultiplied : QImage::Format_RGBX64;
+    }
+    return alpha ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+}
+
+// The kernels for the pixels of a format.
+struct FormatKernels {
+    int pixelSize = 4;
+    StackBlur::LineKernel rows = nullptr;
+    // Blurs `columnGroup` neighbouring columns at once, like a single column of wider pixels.
+    int columnGroup = 1;
+    StackBlur::LineKernel columnGroups = nullptr;
+    // Blurs the columns left over after the last whole group.
+    StackBlur::LineKernel columns = nullptr;
+};
+
+template<typename T>
+static FormatKernels wideKernels()
+{
+    using namespace StackBlur;
+    return {int(sizeof(T)) * 4, wideLines<T, 4>, blockColumns, wideLines<T, 4 * blockColumns>, wideLines<T, 4>};
+}
+
+static FormatKernels formatKernels(QImage::Format format, StackBlur::Simd simd)
+{
+    using namespace StackBlur;
+    switch (format) {
+    case QImage::Format_RGBX64:
+    case QImage::Format_RGBA64_Premultiplied:
+        return wideKernels<quint16>();
+    case QImage::Format_RGBX16FPx4:
+    case QImage::Format_RGBA16FPx4_Premultiplied:
+        return wideKernels<qfloat16>();
+    case QImage::Format_RGBX32FPx4:
+    case QImage::Format_RGBA32FPx4_Premultiplied:
+        return wideKernels<float>();
+    default:
+        break;
+    }
+
+    auto kernel = lineKernel(simd);
+    auto blockKernel = columnKernel(simd);
+    if (!kernel || !blockKernel) {
+        kernel = scalarLines;
+        blockKernel = scalarColumns;
+    }
+    if (format == QImage::Format_Alpha8) {
+        // Four neighbouring columns of 8-bit pixels are blurred like one column of 32-bit pixels.
+        return {1, scalarAlphaLines, 4, blockKernel, scalarAlphaLines};
+    }
+    return {4, kernel, 1, blockKernel, nullptr};
+}
+
+// The combined stats of all arenas.
+static std::atomic<qsizetype> s_scratchBytes = 0;
+static std::atomic<qsizetype> s_scratchPeakBytes = 0;
+static std::atomic<qsizetype> s_scratchAllocations = 0;
+
+StackBlur::Scratch::~Scratch()
+{
+    release();
+}
+
+uchar *StackBlur::Scratch::data(qsizetype bytes)
+{
+    if (bytes <= m_stats.bytes) {
+        return m_data.get();
+    }
+    release();
+    m_data.reset(new uchar[bytes]);
+    m_stats.bytes = bytes;
+    m_stats.peakBytes = std::max(m_stats.peakBytes, bytes);
+    ++m_stats.allocations;
+
+    const qsizetype total = s_scratchBytes += bytes;
+    qsizetype peak = s_scratchPeakBytes;
+    while (peak < total && !s_scratchPeakBytes.compare_exchange_weak(peak, total)) { }
+    ++s_scratchAllocations;
+    return m_data.get();
+}
+
+void StackBlur::Scratch::release()
+{
+    s_scratchBytes -= m_stats.bytes;
+    m_stats.bytes = 0;
+    m_data.reset();
+}
+
+void StackBlur::Scratch::trim()
+{
+    if (m_stats.bytes > m_maxRetainedBytes) {
+        release();
+    }
+}
+
+qsizetype StackBlur::Scratch::maxRetainedBytes() const
+{
+    return m_maxRetainedBytes;
+}
+
+void StackBlur::Scratch::setMaxRetainedBytes(qsizetype bytes)
+{
+    m_maxRetainedBytes = bytes;
+}
+
+StackBlur::ScratchStats StackBlur::Scratch::stats() const
+{
+    return m_stats;
+}
+
+StackBlur::Scratch &StackBlur::threadScratch()
+{
+    static thread_local Scratch scratch;
+    return scratch;
+}
+
+StackBlur::ScratchStats StackBlur::scratchStats()
+{
+    return {s_scratchBytes, s_scratchPeakBytes, s_scratchAllocations};
+}
+
+QRect StackBlur::sourceRect(const QRect &roi, const QSize &kernelSize)
+{
+    const int radiusX = kernelRadius(kernelSize.width());
+    const int radiusY = kernelRadius(kernelSize.height());
+    return roi.adjusted(-radiusX, -radiusY, radiusX, radiusY);
+}
+
+static void scanlineBlur(QImage &image, QRect roi, const QSize &kernelSize, StackBlur::Simd simd, int maxThreads, StackBlur::Scratch &scratch);
+
+// Blurs with radii beyond the tables by blurring a copy that is downscaled by a power of 2
+// with proportionally smaller radii, then scaling it back up. The details lost by scaling
+// would have been blurred away anyway, and the cost doesn't grow with the radius.
+static void pyramidBlur(QImage &image, const QRect &roi, const QSize &kernelSize, StackBlur::Simd simd, int maxThreads, StackBlur::Scratch &scratch)
+{
+    using namespace StackBlur;
+    auto scaleFactor = [](int radius) {
+        int factor = 1;
+        while (radius > maxRadius * factor) {
+            factor *= 2;
+        }
+        return factor;
+    };
+    const int radiusX = kernelRadius(kernelSize.width());
+    const int radiusY = kernelRadius(kernelSize.height());
+    const int factorX = scaleFactor(radiusX);
+    const int factorY = scaleFactor(radiusY);
+
+    const QRect source = sourceRect(roi, kernelSize).intersected(image.rect());
+    const QSize smallSize{(source.width() + factorX - 1) / factorX, (source.height() + factorY - 1) / factorY};
+    auto small = image.copy(source).scaled(smallSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    const QSize smallKernelSize{(radiusX + factorX / 2) / factorX * 2 + 1, (radiusY + factorY / 2) / factorY * 2 + 1};
+    scanlineBlur(small, small.rect(), smallKernelSize, simd, maxThreads, scratch);
+    auto large = small.scaled(source.size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation).convertToFormat(image.format());
+    copyPixels(large, roi.translated(-source.topLeft()), image, roi.topLeft());
+}
+
+static void scanlineBlur(QImage &image, QRect roi, const QSize &kernelSize, StackBlur::Simd simd, int maxThreads, StackBlur::Scratch &scratch)
+{
+    using namespace StackBlur;
+    if (kernelSize.width() == 1 && kernelSize.height() == 1) {
+        return;
+    }
+    roi = roi.intersected(image.rect());
+    if (roi.isEmpty()) {
+        return;
+    }
+    if (blurConverted(image, roi, kernelSize, kernelFormat(image), [&](QImage &image, const QRect &roi) {
+            scanlineBlur(image, roi, kernelSize, simd, maxThreads, scratch);
+        })) {
+        return;
+    }
+
+    const int radiusX = kernelRadius(kernelSize.width());
+    const int radiusY = kernelRadius(kernelSize.height());
+    if (radiusX == 0 && radiusY == 0) {
+        return;
+    }
+    if (radiusX > maxRadius || radiusY > maxRadius) {
+        pyramidBlur(image, roi, kernelSize, simd, maxThreads, scratch);
+        return;
+    }
+
+    const auto kernels = formatKernels(image.format(), simd);
+    // Every line is blurred independently, so splitting them into bands doesn't change the result.
+    // Bands are whole blocks of columns, so column bands don't write to the same cache lines.
+    auto blurLines = [maxThreads](LineKernel kernel, const Lines &lines, int radius, int granularity) {
+        Parallel::forEachBand(lines.count, granularity, maxThreads, [&](int first, int count) {
+            kernel(lines.band(first, count), radius);
+        });
+    };
+
+    const int pixelSize = kernels.pixelSize;
+    auto blurRows = [&](const Lines &rows, int radius) {
+        blurLines(kernels.rows, rows, radius, blockColumns);
+    };
+    auto blurColumns = [&](const Lines &columns, int radius) {
+        const int group = kernels.columnGroup;
+        auto groups = columns;
+        groups.count = columns.count / group;
+        groups.srcLineStep *= group;
+        groups.dstLineStep *= group;
+        // Groups that are as wide as a block are a block each.
+        blurLines(kernels.columnGroups, groups, radius, group >= blockColumns ? 1 : blockColumns);
+        if (columns.count % group > 0) {
+            blurLines(kernels.columns, columns.band(groups.count * group, columns.count % group), radius, blockColumns);
+        }
+    };
+
+    // The rows that are blurred horizontally: the ROI and the rows above and below it
+    // that the vertical pass reads. Columns outside of the ROI are only read by the horizontal pass.
+    const int top = std::max(roi.top() - radiusY, 0);
+    const int bottom = std::min(roi.bottom() + 1 + radiusY, image.height());
+    const int rowCount = bottom - top;
+
+    // The intermediate image between the passes, tightly packed.
+    const qsizetype bufferStride = qsizetype(roi.width()) * pixelSize;
+    uchar *buffer = scratch.data(bufferStride * rowCount);
+    const qsizetype stride = image.bytesPerLine();
+    uchar *bits = image.bits();
+    uchar *roiBits = bits + roi.top() * stride + roi.left() * pixelSize;
+    // Also applied to the horizontal pass, so it doesn't matter which of the passes comes last.
+    const quint32 orMask = opaqueMask(image.format());
+
+    // The kernels can't work in place, so there is always a pass to or from the buffer,
+    // even if one of the radii is 0.
+    if (radiusX > 0) {
+        const Lines rows{bits + top * stride, pixelSize, stride, buffer, pixelSize, bufferStride, rowCount, image.width(), roi.left(), roi.right() + 1, orMask};
+        blurRows(rows, radiusX);
+    } else {
+        for (int y = 0; y < rowCount; ++y) {
+            std::memcpy(buffer + y * bufferStride, bits + (top + y) * stride + roi.left() * pixelSize, bufferStride);
+        }
+    }
+
+    if (radiusY > 0) {
+        const Lines columns{buffer, bufferStride, pixelSize, roiBits, stride, pixelSize, roi.width(), rowCount, roi.top() - top, roi.bottom() + 1 - top, orMask};
+        blurColumns(columns, radiusY);
+    } else {
+        for (int y = 0; y < roi.height(); ++y) {
+            std::memcpy(roiBits + y * stride, buffer + y * bufferStride, bufferStride);
+        }
+    }
+    scratch.trim();
+}
+
+// Backends
+
+namespace
+{
+// Blurs `roi`, which is inside the image. Returns false if the backend can't blur the image.
+using BackendBlur = bool (*)(QImage &image, const QRect &roi, const QSize &kernelSize, StackBlur::Scratch &scratch, int maxThreads);
+
+struct BackendEntry {
+    StackBlur::Backend backend;
+    BackendBlur blur;
+};
+}
+
+static bool scanlineBackendBlur(QImage &image, const QRect &roi, const QSize &kernelSize, StackBlur::Scratch &scratch, int maxThreads)
+{
+    scanlineBlur(image, roi, kernelSize, StackBlur::bestSimd(), maxThreads, scratch);
+    return true;
+}
+
+#ifdef HAVE_OPENCV
+static bool openCvBackendBlur(QImage &image, const QRect &roi, const QSize &kernelSize, StackBlur::Scratch &scratch, int maxThreads)
+{
+    using namespace StackBlur;
+    if (blurConverted(image, roi, kernelSize, premultipliedFormat(image.format()), [&](QImage &image, const QRect &roi) {
+            if (!openCvBlur(image, roi, kernelSize)) {
+                scanlineBlur(image, roi, kernelSize, bestSimd(), maxThreads, scratch);
+            }
+        })) {
+        return true;
+    }
+    return openCvBlur(image, roi, kernelSize);
+}
+#endif
+
+// The backends that are built in.
+static const BackendEntry s_backends[] = {
+    {StackBlur::Backend::Scanline, scanlineBackendBlur},
+#ifdef HAVE_OPENCV
+    {StackBlur::Backend::OpenCV, openCvBackendBlur},
+#endif
+};
+
+static const BackendEntry *findBackend(StackBlur::Backend backend)
+{
+    for (const auto &entry : s_backends) {
+        if (entry.backend == backend) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+QList<StackBlur::Backend> StackBlur::availableBackends()
+{
+    QList<Backend> backends;
+    for (const auto &entry : s_backends) {
+        backends.append(entry.backend);
+    }
+    return backends;
+}
+
+bool StackBlur::isAvailable(Backend backend)
+{
+    return backend == Backend::Auto || findBackend(backend);
+}
+
+const char *StackBlur::backendName(Backend backend)
+{
+    switch (backend) {
+    case Backend::Auto:
+        return "auto";
+    case Backend::Scanline:
+        return "scanline";
+    case Backend::OpenCV:
+        return "opencv";
+    }
+    return "";
+}
+
+std::optional<StackBlur::Backend> StackBlur::backendForName(const QByteArray &name)
+{
+    for (auto backend : {Backend::Auto, Backend::Scanline, Backend::OpenCV}) {
+        if (name.compare(backendName(backend), Qt::CaseInsensitive) == 0) {
+            return backend;
+        }
+    }
+    return std::nullopt;
+}
+
+static StackBlur::Backend initialBackend()
+{
+    const auto name = qgetenv("KQUICKIMAGEEDITOR_BLUR_BACKEND");
+    if (name.isEmpty()) {
+        return StackBlur::Backend::Auto;
+    }
+    if (const auto backend = StackBlur::backendForName(name)) {
+        return *backend;
+    }
+    qWarning() << "Unknown blur backend in KQUICKIMAGEEDITOR_BLUR_BACKEND:" << name << "- using auto";
+    return StackBlur::Backend::Auto;
+}
+
+static std::atomic<StackBlur::Backend> &selectedBackend()
+{
+    static std::atomic<StackBlur::Backend> backend = initialBackend();
+    return backend;
+}
+
+StackBlur::Backend StackBlur::backend()
+{
+    return selectedBackend();
+}
+
+void StackBlur::setBackend(Backend backend)
+{
+    selectedBackend() = backend;
+}
+
+static std::atomic<qsizetype> s_autoMinPixels = StackBlur::AutoThresholds{}.minPixels;
+static std::atomic<qsizetype> s_autoMinWidePixels = StackBlur::AutoThresholds{}.minWidePixels;
+
+StackBlur::AutoThresholds StackBlur::autoThresholds()
+{
+    return {s_autoMinPixels, s_autoMinWidePixels};
+}
+
+void StackBlur::setAutoThresholds(const AutoThresholds &thresholds)
+{
+    s_autoMinPixels = thresholds.minPixels;
+    s_autoMinWidePixels = thresholds.minWidePixels;
+}
+
+StackBlur::Backend StackBlur::autoBackend(const QImage &image, const QRect &roi, const QSize &kernelSize)
+{
+    if (!findBackend(Backend::OpenCV)) {
+        return Backend::Scanline;
+    }
+    // The cost of both grows with the pixels that are read, not with the radius.
+    const QRect source = sourceRect(roi, kernelSize).intersected(image.rect());
+    const qsizetype pixels = qsizetype(source.width()) * source.height();
+    const auto thresholds = autoThresholds();
+    const qsizetype minPixels = image.depth() > 32 ? thresholds.minWidePixels : thresholds.minPixels;
+    return pixels >= minPixels ? Backend::OpenCV : Backend::Scanline;
+}
+
+void StackBlur::blur(QImage &image, const QSize &kernelSize)
+{
+    parallelBlur(image, image.rect(), kernelSize, 1);
+}
+
+void StackBlur::blur(QImage &image, const QSize &kernelSize, Backend backend)
+{
+    parallelBlur(image, image.rect(), kernelSize, backend, threadScratch(), 1);
+}
+
+void StackBlur::blur(QImage &image, const QSize &kernelSize, Simd simd)
+{
+    scanlineBlur(image, image.rect(), kernelSize, simd, 1, threadScratch());
+}
+
+void StackBlur::blur(QImage &image, const QRect &roi, const QSize &kernelSize)
+{
+    parallelBlur(image, roi, kernelSize, 1);
+}
+
+void StackBlur::parallelBlur(QImage &image, const QSize &kernelSize, int maxThreads)
+{
+    parallelBlur(image, image.rect(), kernelSize, maxThreads);
+}
+
+void StackBlur::parallelBlur(QImage &image, const QSize &kernelSize, Simd simd, int maxThreads)
+{
+    scanlineBlur(image, image.rect(), kernelSize, simd, maxThreads, threadScratch());
+}
+
+void StackBlur::parallelBlur(QImage &image, const QRect &roi, const QSize &kernelSize, int maxThreads)
+{
+    parallelBlur(image, roi, kernelSize, threadScratch(), maxThreads);
+}
+
+void StackBlur::parallelBlur(QImage &image, const QRect &roi, const QSize &kernelSize, Scratch &scratch, int maxThreads)
+{
+    parallelBlur(image, roi, kernelSize, backend(), scratch, maxThreads);
+}
+
+void StackBlur::parallelBlur(QImage &image, const QRect &roi, const QSize &kernelSize, Backend backend, Scratch &scratch, int maxThreads)
+{
+    // Like in the original implementation, a 1x1 kernel doesn't blur.
+    if (kernelSize.width() == 1 && kernelSize.height() == 1) {
+        return;
+    }
+    const QRect clippedRoi = roi.intersected(image.rect());
+    if (clippedRoi.isEmpty()) {
+        return;
+    }
+    if (backend == Backend::Auto) {
+        backend = autoBackend(image, clippedRoi, kernelSize);
+    }
+    const auto entry = findBackend(backend);
+    if (entry && entry->blur(image, clippedRoi, kernelSize, scratch, maxThreads)) {
+        return;
     }
+    scanlineBlur(image, clippedRoi, kernelSize, bestSimd(), maxThreads, scratch);
 }
@@ -8,10 +8,174 @@
 //
 // SPDX-License-Identifier: BSD-2-Clause
 
+#pragma once
+
+#include <QList>
+#include <QtGlobal>
+
+#include <memory>
+#include <optional>
+
+class QByteArray;
 class QImage;
+class QRect;
 class QSize;
 
 namespace StackBlur
 {
+// The instruction sets the scanline kernels can be built for.
+// `None` is the portable C++ version of the scanline kernels.
+enum class Simd {
+    None,
+    SSE2,
+    AVX2,
+    NEON,
+};
+
+// Whether kernels for the instruction set are built in and the CPU can run them.
+bool isSupported(Simd simd);
+
+// The fastest instruction set supported by the CPU, detected once at runtime.
+Simd bestSimd();
+
+// The implementations that blur images. All of them blur the same way and give the same
+// result, give or take rounding, so they can be switched at runtime.
+enum class Backend {
+    // Pick one of the others for each blur, based on the image format, the size of the ROI and the kernel size.
+    Auto,
+    // The scanline kernels with the fastest instruction set. Always available.
+    Scanline,
+    // cv::stackBlur(). Only available when built with OpenCV.
+    OpenCV,
+};
+
+// The backends built in, without `Backend::Auto`.
+QList<Backend> availableBackends();
+
+// Whether the backend is built in. `Backend::Auto` always is.
+bool isAvailable(Backend backend);
+
+// The name of the backend, as used by the KQUICKIMAGEEDITOR_BLUR_BACKEND environment variable:
+// "auto", "scanline" or "opencv".
+const char *backendName(Backend backend);
+
+// The backend with the name, or nothing if there is no backend with that name.
+std::optional<Backend> backendForName(const QByteArray &name);
+
+// The backend used by blurs that don't specify one. Initially read from the
+// KQUICKIMAGEEDITOR_BLUR_BACKEND environment variable, `Backend::Auto` if it isn't set.
+Backend backend();
+
+// Use `backend` for blurs that don't specify one.
+// Blurs with a backend that isn't available use `Backend::Scanline`.
+void setBackend(Backend backend);
+
+// When `Backend::Auto` picks OpenCV over the scanline kernels.
+// The scanline kernels are faster for small images, because they don't have the overhead
+// of wrapping and threading a blur in OpenCV, and their 8-bit kernels are vectorized for larger radii too.
+struct AutoThresholds {
+    // The fewest pixels read by the blur, i.e. in sourceRect(), to use OpenCV
+    // for images with 8-bit channels.
+    qsizetype minPixels = 1024 * 1024;
+    // The same for images with 16-bit or floating point channels, which the scanline kernels don't vectorize.
+    qsizetype minWidePixels = 128 * 128;
+};
+AutoThresholds autoThresholds();
+void setAutoThresholds(const AutoThresholds &thresholds);
+
+// The backend `Backend::Auto` uses to blur `roi` of `image`.
+Backend autoBackend(const QImage &image, const QRect &roi, const QSize &kernelSize);
+
+// Memory use of scratch arenas.
+struct ScratchStats {
+    // The bytes currently allocated.
+    qsizetype bytes = 0;
+    // The most bytes that were allocated at the same time.
+    qsizetype peakBytes = 0;
+    // How often memory had to be allocated because it wasn't large enough.
+    qsizetype allocations = 0;
+};
+
+/**
+ * Reusable memory for the intermediate image between the horizontal and the vertical pass.
+ *
+ * It grows, so blurring images of the same size again doesn't allocate. Memory above
+ * maxRetainedBytes() is freed after each blur, so threads that live as long as the process
+ * don't keep the buffer of the largest image they ever blurred.
+ * Blurs without an explicit arena use the arena of the calling thread from threadScratch().
+ * An arena must not be used by multiple blurs at the same time.
+ */
+class Scratch
+{
+public:
+    Scratch() = default;
+    ~Scratch();
+    Q_DISABLE_COPY_MOVE(Scratch)
+
+    // At least `bytes` of memory, valid until the next call, release() or trim().
+    uchar *data(qsizetype bytes);
+    // Frees the memory, e.g. after blurring an unusually large image.
+    void release();
+    // Frees the memory if it is more than maxRetainedBytes(). Blurs call this when they are done.
+    void trim();
+    // Enough for the intermediate image of a 4K screenshot by default.
+    qsizetype maxRetainedBytes() const;
+    void setMaxRetainedBytes(qsizetype bytes);
+    ScratchStats stats() const;
+
+private:
+    std::unique_ptr<uchar[]> m_data;
+    ScratchStats m_stats;
+    qsizetype m_maxRetainedBytes = 64 * 1024 * 1024;
+};
+
+// The arena of the calling thread.
+Scratch &threadScratch();
+
+// The combined memory use of all arenas in the process.
+ScratchStats scratchStats();
+
+// Blur with backend(), which picks the fastest available implementation by default.
+// All channels including alpha are blurred. Images with unpremultiplied alpha
+// are blurred in their premultiplied format and converted back.
+// Format_Alpha8 images are blurred in place, e.g. for shadows.
+// Formats with 16-bit or floating point channels are blurred in their own precision.
+// Other formats are blurred in a copy with a format that doesn't lose precision.
+// `kernelSize` is the width and height of the kernel like the ksize of cv::stackBlur(),
+// twice the radius plus one. Even sizes are blurred like the odd size below them.
+// Radii above 254 blur a downscaled copy of the image and scale it back up.
 void blur(QImage &image, const QSize &kernelSize);
+
+// Blur with the backend instead of backend().
+void blur(QImage &image, const QSize &kernelSize, Backend backend);
+
+// Blur with the scanline kernels for the given instruction set.
+// Falls back to `Simd::None` if the instruction set is not supported.
+// Only images with 8-bit channels use the instruction set, the others use the portable kernels.
+void blur(QImage &image, const QSize &kernelSize, Simd simd);
+
+// Blur only the pixels inside `roi`, leaving the rest of the image untouched.
+// Only the pixels inside sourceRect() are read. The pixels inside `roi` are the same
+// as if the whole image was blurred, or close to it for radii above 254.
+void blur(QImage &image, const QRect &roi, const QSize &kernelSize);
+
+// The pixels that blurring `roi` reads: `roi` and an apron of the kernel radius around it.
+// Parts outside of the image are not read.
+QRect sourceRect(const QRect &roi, const QSize &kernelSize);
+
+// Blur like blur(), but split each pass into bands of rows or columns and blur them
+// on up to `maxThreads` threads of QThreadPool::globalInstance(), including the calling thread.
+// 0 means as many threads as the pool allows. The result is identical to blur().
+void parallelBlur(QImage &image, const QSize &kernelSize, int maxThreads = 0);
+void parallelBlur(QImage &image, const QSize &kernelSize, Simd simd, int maxThreads = 0);
+void parallelBlur(QImage &image, const QRect &roi, const QSize &kernelSize, int maxThreads = 0);
+// Use `scratch` for the intermediate image instead of threadScratch().
+void parallelBlur(QImage &image, const QRect &roi, const QSize &kernelSize, Scratch &scratch, int maxThreads = 0);
+// Blur with the backend instead of backend(). OpenCV ignores `maxThreads` and `scratch`.
+void parallelBlur(QImage &image, const QRect &roi, const QSize &kernelSize, Backend backend, Scratch &scratch, int maxThreads = 0);
+
+// The original implementation using QImage::pixel() and QImage::setPixel(),
+// blurring alpha like the other implementations. Radii are limited to 254.
+// Kept to verify and benchmark the scanline kernels against.
+void referenceBlur(QImage &image, const QSize &kernelSize);
 }
@@ -1,7 +1,7 @@
 // SPDX-FileCopyrightText: 2024 Noah Davis <noahadvs@gmail.com>
 // SPDX-License-Identifier: LGPL-2.0-or-later
 
-#include "stackblur.h"
+#include "stackblur_p.h"
 
 #include <QImage>
 #include <opencv2/opencv.hpp>
@@ -32,7 +32,8 @@ inline constexpr int matType(QPixelFormat::TypeInterpretation typeInterpretation
 inline constexpr int matType(QPixelFormat pixelFormat)
 {
     const auto baseType = matType(pixelFormat.typeInterpretation());
-    if (baseType == INVALID_MAT_TYPE) {
+    // OpenCV can't blur half floats, those are left to the native kernels.
+    if (baseType == INVALID_MAT_TYPE || (baseType == CV_32F && pixelFormat.redSize() != 32)) {
         return INVALID_MAT_TYPE;
     }
     return CV_MAKETYPE(baseType, pixelFormat.channelCount());
@@ -47,10 +48,30 @@ inline cv::Mat qImageToMat(QImage &image)
     // Use the constructor with cv::Size as the first arg to avoid type ambiguity in the args.
     return cv::Mat(cv::Size{image.width(), image.height()}, type, image.bits(), image.bytesPerLine());
 }
+
+inline cv::Rect cvRect(const QRect &rect)
+{
+    return {rect.x(), rect.y(), rect.width(), rect.height()};
+}
 }
 
-void StackBlur::blur(QImage &image, const QSize &kernelSize)
+bool StackBlur::openCvBlur(QImage &image, const QRect &roi, const QSize &kernelSize)
 {
     auto mat = qImageToMat(image);
-    cv::stackBlur(mat, mat, {kernelSize.width(), kernelSize.height()});
+    if (mat.empty()) {
+        return false;
+    }
+    // OpenCV only takes odd sizes, which the kernel sizes of the callers already are.
+    const cv::Size ksize{kernelRadius(kernelSize.width()) * 2 + 1, kernelRadius(kernelSize.height()) * 2 + 1};
+    if (roi == image.rect()) {
+        cv::stackBlur(mat, mat, ksize);
+        return true;
+    }
+    // Blur the ROI with its apron into a separate matrix, then copy just the ROI back.
+    const QRect source = sourceRect(roi, kernelSize).intersected(image.rect());
+    const QRect sourceRoi = roi.translated(-source.topLeft());
+    cv::Mat blurred;
+    cv::stackBlur(mat(cvRect(source)), blurred, ksize);
+    blurred(cvRect(sourceRoi)).copyTo(mat(cvRect(roi)));
+    return true;
 }
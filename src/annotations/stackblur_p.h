@@ -0,0 +1,113 @@
+// SPDX-FileCopyrightText: 2006 Zack Rusin <zack@kde.org>
+// SPDX-FileCopyrightText: 2006-2007, 2008 Fredrik Höglund <fredrik@kde.org>
+//
+// The stack blur algorithm was invented by Mario Klingemann <mario@quasimondo.com>
+//
+// This implementation is based on the version in Anti-Grain Geometry Version 2.4,
+// SPDX-FileCopyrightText: 2002-2005 Maxim Shemanarev (http://www.antigrain.com)
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#pragma once
+
+#include "stackblur.h"
+
+#include <QtGlobal>
+
+// Which SIMD kernels can be compiled for the target architecture.
+// Whether the CPU can run them is checked at runtime.
+#if defined(Q_PROCESSOR_X86) && (defined(Q_CC_GNU) || defined(Q_CC_MSVC))
+#define STACKBLUR_HAVE_SSE2
+#define STACKBLUR_HAVE_AVX2
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define STACKBLUR_HAVE_NEON
+#endif
+
+namespace StackBlur
+{
+// The largest radius covered by mulTable and shgTable.
+static constexpr int maxRadius = 254;
+
+// Kernel sizes are the whole width of the kernel like the ksize of OpenCV, twice the radius plus one.
+// Even sizes are rounded down to the odd size below them.
+inline int kernelRadius(int kernelSize)
+{
+    return kernelSize > 0 ? kernelSize / 2 : 0;
+}
+
+// (sum * mulTable[radius]) >> shgTable[radius] divides sum by (radius + 1)^2.
+// The product always fits in 32 unsigned bits for 8-bit channels.
+extern const unsigned short mulTable[maxRadius + 1];
+extern const unsigned char shgTable[maxRadius + 1];
+
+/**
+ * A set of parallel lines of pixels for the scanline kernels to blur along.
+ *
+ * Rows are lines with a pixel step of the pixel size and a line step of bytesPerLine.
+ * Columns are lines with a pixel step of bytesPerLine and a line step of the pixel size.
+ * The source and destination must not overlap.
+ */
+struct Lines {
+    const uchar *src = nullptr;
+    qsizetype srcPixelStep = 4;
+    qsizetype srcLineStep = 0;
+    uchar *dst = nullptr;
+    qsizetype dstPixelStep = 4;
+    qsizetype dstLineStep = 0;
+    // The number of lines.
+    int count = 0;
+    // The number of readable pixels in each source line. Reads are clamped to [0, size).
+    int size = 0;
+    // The range of pixels to output. Pixel `begin` is written to the first destination pixel.
+    int begin = 0;
+    int end = 0;
+    // OR'd into every output pixel, e.g. to keep the alpha channel opaque.
+    quint32 orMask = 0;
+
+    // The lines from `first` to `first + count`.
+    Lines band(int first, int count) const
+    {
+        auto band = *this;
+        band.src += first * srcLineStep;
+        band.dst += first * dstLineStep;
+        band.count = count;
+        return band;
+    }
+};
+
+// Blurs every line of 32-bit pixels with a radius from 1 to maxRadius.
+// Each of the 4 bytes of a pixel is blurred as a separate channel.
+using LineKernel = void (*)(const Lines &lines, int radius);
+
+// The byte offset of pixel `i` in a line, clamped to the first and last pixel.
+inline qsizetype clampedOffset(int i, int last, qsizetype step)
+{
+    return qsizetype(i < 0 ? 0 : i > last ? last : i) * step;
+}
+
+void scalarLines(const Lines &lines, int radius);
+// Like scalarLines(), but for 8-bit pixels with a single channel.
+void scalarAlphaLines(const Lines &lines, int radius);
+
+// The kernel for the instruction set or nullptr if it isn't supported.
+LineKernel lineKernel(Simd simd);
+
+// The number of neighbouring columns the column kernels blur together.
+// 128 bytes of 32-bit pixels, the pair of cache lines CPUs tend to fetch together.
+static constexpr int blockColumns = 32;
+
+// Like scalarLines(), but for lines of neighbouring 32-bit pixels like the columns of an image,
+// with line steps of 4 bytes. Blocks of blockColumns lines are blurred together one row at a time,
+// so each row of a block is read with whole cache lines instead of one cache line per column.
+void scalarColumns(const Lines &lines, int radius);
+
+// The column kernel for the instruction set or nullptr if it isn't supported.
+LineKernel columnKernel(Simd simd);
+
+#ifdef HAVE_OPENCV
+// Blur `roi` with OpenCV. Returns false if OpenCV can't handle the image format.
+// `roi` must be inside the image.
+bool openCvBlur(QImage &image, const QRect &roi, const QSize &kernelSize);
+#endif
+}
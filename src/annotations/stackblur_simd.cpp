@@ -0,0 +1,538 @@
+// SPDX-FileCopyrightText: 2006 Zack Rusin <zack@kde.org>
+// SPDX-FileCopyrightText: 2006-2007, 2008 Fredrik Höglund <fredrik@kde.org>
+//
+// The stack blur algorithm was invented by Mario Klingemann <mario@quasimondo.com>
+//
+// This implementation is based on the version in Anti-Grain Geometry Version 2.4,
+// SPDX-FileCopyrightText: 2002-2005 Maxim Shemanarev (http://www.antigrain.com)
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "stackblur_p.h"
+
+#include <QtEndian>
+
+#if defined(STACKBLUR_HAVE_SSE2) || defined(STACKBLUR_HAVE_AVX2)
+#include <immintrin.h>
+#ifdef Q_CC_MSVC
+#include <intrin.h>
+#endif
+#endif
+#ifdef STACKBLUR_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+/**
+ * SIMD versions of StackBlur::scalarLines().
+ *
+ * Each pixel is kept as 4 packed 32-bit lanes, one per channel, so the sums of all channels are
+ * updated with a single instruction. The arithmetic is the same as in the scalar kernel, so the
+ * output is identical.
+ *
+ * The kernels are compiled with function level target attributes instead of compiler flags for
+ * the whole file, so the rest of the library never ends up with instructions the CPU may not have.
+ */
+
+#if defined(Q_CC_GNU)
+#define STACKBLUR_TARGET(x) __attribute__((target(x)))
+#else
+#define STACKBLUR_TARGET(x)
+#endif
+
+using namespace StackBlur;
+
+#ifdef STACKBLUR_HAVE_SSE2
+STACKBLUR_TARGET("sse2") static inline __m128i sse2Load(const uchar *p)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i v = _mm_cvtsi32_si128(qFromUnaligned<int>(p));
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+}
+
+STACKBLUR_TARGET("sse2") static inline void sse2Store(uchar *p, __m128i sum, __m128i mul, __m128i shift, quint32 orMask)
+{
+    // SSE2 has no 32-bit multiply, so multiply the even and odd lanes into 64 bits.
+    const __m128i even = _mm_srl_epi64(_mm_mul_epu32(sum, mul), shift);
+    const __m128i odd = _mm_srl_epi64(_mm_mul_epu32(_mm_srli_epi64(sum, 32), mul), shift);
+    __m128i v = _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+    v = _mm_packs_epi32(v, v);
+    v = _mm_packus_epi16(v, v);
+    qToUnaligned<quint32>(quint32(_mm_cvtsi128_si32(v)) | orMask, p);
+}
+
+STACKBLUR_TARGET("sse2") static void sse2Lines(const Lines &lines, int radius)
+{
+    const __m128i mul = _mm_set1_epi32(mulTable[radius]);
+    const __m128i shift = _mm_cvtsi32_si128(shgTable[radius]);
+    const int last = lines.size - 1;
+
+    for (int line = 0; line < lines.count; ++line) {
+        const uchar *src = lines.src + line * lines.srcLineStep;
+        uchar *dst = lines.dst + line * lines.dstLineStep;
+        __m128i sum = _mm_setzero_si128();
+        __m128i sumIn = _mm_setzero_si128();
+        __m128i sumOut = _mm_setzero_si128();
+
+        for (int i = -radius; i <= radius; ++i) {
+            const __m128i p = sse2Load(src + clampedOffset(lines.begin + i, last, lines.srcPixelStep));
+            // Channels and weights are at most 255, so a 16-bit multiply is enough.
+            sum = _mm_add_epi32(sum, _mm_mullo_epi16(p, _mm_set1_epi32(radius + 1 - std::abs(i))));
+            if (i > 0) {
+                sumIn = _mm_add_epi32(sumIn, p);
+            } else {
+                sumOut = _mm_add_epi32(sumOut, p);
+            }
+        }
+
+        for (int x = lines.begin; x < lines.end; ++x) {
+            sse2Store(dst, sum, mul, shift, lines.orMask);
+            dst += lines.dstPixelStep;
+
+            const __m128i out = sse2Load(src + clampedOffset(x - radius, last, lines.srcPixelStep));
+            const __m128i in = sse2Load(src + clampedOffset(x + radius + 1, last, lines.srcPixelStep));
+            const __m128i next = sse2Load(src + clampedOffset(x + 1, last, lines.srcPixelStep));
+            sum = _mm_sub_epi32(sum, sumOut);
+            sumOut = _mm_sub_epi32(sumOut, out);
+            sumIn = _mm_add_epi32(sumIn, in);
+            sum = _mm_add_epi32(sum, sumIn);
+            sumOut = _mm_add_epi32(sumOut, next);
+            sumIn = _mm_sub_epi32(sumIn, next);
+        }
+    }
+}
+
+// Like scalarColumns(), with one vector per pixel of a block.
+STACKBLUR_TARGET("sse2") static void sse2Columns(const Lines &lines, int radius)
+{
+    Q_ASSERT(lines.srcLineStep == 4 && lines.dstLineStep == 4);
+    const __m128i mul = _mm_set1_epi32(mulTable[radius]);
+    const __m128i shift = _mm_cvtsi32_si128(shgTable[radius]);
+    const int last = lines.size - 1;
+    const qsizetype step = lines.srcPixelStep;
+
+    int column = 0;
+    for (; column + blockColumns <= lines.count; column += blockColumns) {
+        const uchar *src = lines.src + column * 4;
+        uchar *dst = lines.dst + column * 4;
+        __m128i sum[blockColumns];
+        __m128i sumIn[blockColumns];
+        __m128i sumOut[blockColumns];
+        for (int v = 0; v < blockColumns; ++v) {
+            sum[v] = sumIn[v] = sumOut[v] = _mm_setzero_si128();
+        }
+
+        for (int i = -radius; i <= radius; ++i) {
+            const uchar *row = src + clampedOffset(lines.begin + i, last, step);
+            const __m128i weight = _mm_set1_epi32(radius + 1 - std::abs(i));
+            for (int v = 0; v < blockColumns; ++v) {
+                const __m128i p = sse2Load(row + v * 4);
+                sum[v] = _mm_add_epi32(sum[v], _mm_mullo_epi16(p, weight));
+                if (i > 0) {
+                    sumIn[v] = _mm_add_epi32(sumIn[v], p);
+                } else {
+                    sumOut[v] = _mm_add_epi32(sumOut[v], p);
+                }
+            }
+        }
+
+        for (int y = lines.begin; y < lines.end; ++y) {
+            const uchar *out = src + clampedOffset(y - radius, last, step);
+            const uchar *in = src + clampedOffset(y + radius + 1, last, step);
+            const uchar *next = src + clampedOffset(y + 1, last, step);
+            for (int v = 0; v < blockColumns; ++v) {
+                sse2Store(dst + v * 4, sum[v], mul, shift, lines.orMask);
+                const __m128i nextPixel = sse2Load(next + v * 4);
+                sum[v] = _mm_sub_epi32(sum[v], sumOut[v]);
+                sumOut[v] = _mm_sub_epi32(sumOut[v], sse2Load(out + v * 4));
+                sumIn[v] = _mm_add_epi32(sumIn[v], sse2Load(in + v * 4));
+                sum[v] = _mm_add_epi32(sum[v], sumIn[v]);
+                sumOut[v] = _mm_add_epi32(sumOut[v], nextPixel);
+                sumIn[v] = _mm_sub_epi32(sumIn[v], nextPixel);
+            }
+            dst += lines.dstPixelStep;
+        }
+    }
+
+    if (column < lines.count) {
+        sse2Lines(lines.band(column, lines.count - column), radius);
+    }
+}
+#endif
+
+#ifdef STACKBLUR_HAVE_AVX2
+// Two lines are blurred at once, one in each 128-bit half.
+STACKBLUR_TARGET("avx2") static inline __m256i avx2Load(const uchar *a, const uchar *b)
+{
+    const __m128i v = _mm_unpacklo_epi32(_mm_cvtsi32_si128(qFromUnaligned<int>(a)), //
+                                         _mm_cvtsi32_si128(qFromUnaligned<int>(b)));
+    return _mm256_cvtepu8_epi32(v);
+}
+
+STACKBLUR_TARGET("avx2") static inline void avx2Store(uchar *a, uchar *b, __m256i sum, __m256i mul, __m128i shift, quint32 orMask)
+{
+    __m256i v = _mm256_srl_epi32(_mm256_mullo_epi32(sum, mul), shift);
+    v = _mm256_packus_epi32(v, v);
+    v = _mm256_packus_epi16(v, v);
+    qToUnaligned<quint32>(quint32(_mm_cvtsi128_si32(_mm256_castsi256_si128(v))) | orMask, a);
+    qToUnaligned<quint32>(quint32(_mm_cvtsi128_si32(_mm256_extracti128_si256(v, 1))) | orMask, b);
+}
+
+STACKBLUR_TARGET("avx2") static void avx2Lines(const Lines &lines, int radius)
+{
+    const __m256i mul = _mm256_set1_epi32(mulTable[radius]);
+    const __m128i shift = _mm_cvtsi32_si128(shgTable[radius]);
+    const int last = lines.size - 1;
+    const qsizetype srcStep = lines.srcPixelStep;
+
+    int line = 0;
+    for (; line + 1 < lines.count; line += 2) {
+        const uchar *a = lines.src + line * lines.srcLineStep;
+        const uchar *b = a + lines.srcLineStep;
+        uchar *dstA = lines.dst + line * lines.dstLineStep;
+        uchar *dstB = dstA + lines.dstLineStep;
+        __m256i sum = _mm256_setzero_si256();
+        __m256i sumIn = _mm256_setzero_si256();
+        __m256i sumOut = _mm256_setzero_si256();
+
+        for (int i = -radius; i <= radius; ++i) {
+            const qsizetype offset = clampedOffset(lines.begin + i, last, srcStep);
+            const __m256i p = avx2Load(a + offset, b + offset);
+            sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(p, _mm256_set1_epi32(radius + 1 - std::abs(i))));
+            if (i > 0) {
+                sumIn = _mm256_add_epi32(sumIn, p);
+            } else {
+                sumOut = _mm256_add_epi32(sumOut, p);
+            }
+        }
+
+        for (int x = lines.begin; x < lines.end; ++x) {
+            avx2Store(dstA, dstB, sum, mul, shift, lines.orMask);
+            dstA += lines.dstPixelStep;
+            dstB += lines.dstPixelStep;
+
+            const qsizetype outOffset = clampedOffset(x - radius, last, srcStep);
+            const qsizetype inOffset = clampedOffset(x + radius + 1, last, srcStep);
+            const qsizetype nextOffset = clampedOffset(x + 1, last, srcStep);
+            const __m256i out = avx2Load(a + outOffset, b + outOffset);
+            const __m256i in = avx2Load(a + inOffset, b + inOffset);
+            const __m256i next = avx2Load(a + nextOffset, b + nextOffset);
+            sum = _mm256_sub_epi32(sum, sumOut);
+            sumOut = _mm256_sub_epi32(sumOut, out);
+            sumIn = _mm256_add_epi32(sumIn, in);
+            sum = _mm256_add_epi32(sum, sumIn);
+            sumOut = _mm256_add_epi32(sumOut, next);
+            sumIn = _mm256_sub_epi32(sumIn, next);
+        }
+    }
+
+    if (line < lines.count) {
+        Lines remainder = lines;
+        remainder.src += line * lines.srcLineStep;
+        remainder.dst += line * lines.dstLineStep;
+        remainder.count = 1;
+        sse2Lines(remainder, radius);
+    }
+}
+
+// Two neighbouring pixels of the same line.
+STACKBLUR_TARGET("avx2") static inline __m256i avx2LoadPixels(const uchar *p)
+{
+    return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+}
+
+// Like scalarColumns(), with one vector per two neighbouring pixels of a block.
+STACKBLUR_TARGET("avx2") static void avx2Columns(const Lines &lines, int radius)
+{
+    Q_ASSERT(lines.srcLineStep == 4 && lines.dstLineStep == 4);
+    constexpr int vectors = blockColumns / 2;
+    const __m256i mul = _mm256_set1_epi32(mulTable[radius]);
+    const __m128i shift = _mm_cvtsi32_si128(shgTable[radius]);
+    const int last = lines.size - 1;
+    const qsizetype step = lines.srcPixelStep;
+
+    int column = 0;
+    for (; column + blockColumns <= lines.count; column += blockColumns) {
+        const uchar *src = lines.src + column * 4;
+        uchar *dst = lines.dst + column * 4;
+        __m256i sum[vectors];
+        __m256i sumIn[vectors];
+        __m256i sumOut[vectors];
+        for (int v = 0; v < vectors; ++v) {
+            sum[v] = sumIn[v] = sumOut[v] = _mm256_setzero_si256();
+        }
+
+        for (int i = -radius; i <= radius; ++i) {
+            const uchar *row = src + clampedOffset(lines.begin + i, last, step);
+            const __m256i weight = _mm256_set1_epi32(radius + 1 - std::abs(i));
+            for (int v = 0; v < vectors; ++v) {
+                const __m256i p = avx2LoadPixels(row + v * 8);
+                sum[v] = _mm256_add_epi32(sum[v], _mm256_mullo_epi32(p, weight));
+                if (i > 0) {
+                    sumIn[v] = _mm256_add_epi32(sumIn[v], p);
+                } else {
+                    sumOut[v] = _mm256_add_epi32(sumOut[v], p);
+                }
+            }
+        }
+
+        for (int y = lines.begin; y < lines.end; ++y) {
+            const uchar *out = src + clampedOffset(y - radius, last, step);
+            const uchar *in = src + clampedOffset(y + radius + 1, last, step);
+            const uchar *next = src + clampedOffset(y + 1, last, step);
+            for (int v = 0; v < vectors; ++v) {
+                avx2Store(dst + v * 8, dst + v * 8 + 4, sum[v], mul, shift, lines.orMask);
+                const __m256i nextPixels = avx2LoadPixels(next + v * 8);
+                sum[v] = _mm256_sub_epi32(sum[v], sumOut[v]);
+                sumOut[v] = _mm256_sub_epi32(sumOut[v], avx2LoadPixels(out + v * 8));
+                sumIn[v] = _mm256_add_epi32(sumIn[v], avx2LoadPixels(in + v * 8));
+                sum[v] = _mm256_add_epi32(sum[v], sumIn[v]);
+                sumOut[v] = _mm256_add_epi32(sumOut[v], nextPixels);
+                sumIn[v] = _mm256_sub_epi32(sumIn[v], nextPixels);
+            }
+            dst += lines.dstPixelStep;
+        }
+    }
+
+    if (column < lines.count) {
+        avx2Lines(lines.band(column, lines.count - column), radius);
+    }
+}
+
+static bool cpuHasAvx2()
+{
+#ifdef Q_CC_MSVC
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    const bool osxsave = info[2] & (1 << 27);
+    const bool avx = info[2] & (1 << 28);
+    // The OS must also save the YMM registers on context switches.
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+static bool cpuHasSse2()
+{
+#if defined(Q_PROCESSOR_X86_64)
+    return true;
+#elif defined(STACKBLUR_HAVE_SSE2) && defined(Q_CC_MSVC)
+    int info[4];
+    __cpuid(info, 1);
+    return info[3] & (1 << 26);
+#elif defined(STACKBLUR_HAVE_SSE2)
+    return __builtin_cpu_supports("sse2");
+#else
+    return false;
+#endif
+}
+
+#ifdef STACKBLUR_HAVE_NEON
+static inline uint32x4_t neonLoad(const uchar *p)
+{
+    const uint8x8_t v = vreinterpret_u8_u32(vdup_n_u32(qFromUnaligned<quint32>(p)));
+    return vmovl_u16(vget_low_u16(vmovl_u8(v)));
+}
+
+static inline void neonStore(uchar *p, uint32x4_t sum, uint32x4_t mul, int32x4_t shift, quint32 orMask)
+{
+    // Shifting left by a negative amount shifts right.
+    const uint16x4_t v = vmovn_u32(vshlq_u32(vmulq_u32(sum, mul), shift));
+    const uint8x8_t bytes = vmovn_u16(vcombine_u16(v, v));
+    qToUnaligned<quint32>(vget_lane_u32(vreinterpret_u32_u8(bytes), 0) | orMask, p);
+}
+
+static void neonLines(const Lines &lines, int radius)
+{
+    const uint32x4_t mul = vdupq_n_u32(mulTable[radius]);
+    const int32x4_t shift = vdupq_n_s32(-shgTable[radius]);
+    const int last = lines.size - 1;
+
+    for (int line = 0; line < lines.count; ++line) {
+        const uchar *src = lines.src + line * lines.srcLineStep;
+        uchar *dst = lines.dst + line * lines.dstLineStep;
+        uint32x4_t sum = vdupq_n_u32(0);
+        uint32x4_t sumIn = vdupq_n_u32(0);
+        uint32x4_t sumOut = vdupq_n_u32(0);
+
+        for (int i = -radius; i <= radius; ++i) {
+            const uint32x4_t p = neonLoad(src + clampedOffset(lines.begin + i, last, lines.srcPixelStep));
+            sum = vmlaq_n_u32(sum, p, radius + 1 - std::abs(i));
+            if (i > 0) {
+                sumIn = vaddq_u32(sumIn, p);
+            } else {
+                sumOut = vaddq_u32(sumOut, p);
+            }
+        }
+
+        for (int x = lines.begin; x < lines.end; ++x) {
+            neonStore(dst, sum, mul, shift, lines.orMask);
+            dst += lines.dstPixelStep;
+
+            const uint32x4_t out = neonLoad(src + clampedOffset(x - radius, last, lines.srcPixelStep));
+            const uint32x4_t in = neonLoad(src + clampedOffset(x + radius + 1, last, lines.srcPixelStep));
+            const uint32x4_t next = neonLoad(src + clampedOffset(x + 1, last, lines.srcPixelStep));
+            sum = vsubq_u32(sum, sumOut);
+            sumOut = vsubq_u32(sumOut, out);
+            sumIn = vaddq_u32(sumIn, in);
+            sum = vaddq_u32(sum, sumIn);
+            sumOut = vaddq_u32(sumOut, next);
+            sumIn = vsubq_u32(sumIn, next);
+        }
+    }
+}
+
+// Like scalarColumns(), with one vector per pixel of a block.
+static void neonColumns(const Lines &lines, int radius)
+{
+    Q_ASSERT(lines.srcLineStep == 4 && lines.dstLineStep == 4);
+    const uint32x4_t mul = vdupq_n_u32(mulTable[radius]);
+    const int32x4_t shift = vdupq_n_s32(-shgTable[radius]);
+    const int last = lines.size - 1;
+    const qsizetype step = lines.srcPixelStep;
+
+    int column = 0;
+    for (; column + blockColumns <= lines.count; column += blockColumns) {
+        const uchar *src = lines.src + column * 4;
+        uchar *dst = lines.dst + column * 4;
+        uint32x4_t sum[blockColumns];
+        uint32x4_t sumIn[blockColumns];
+        uint32x4_t sumOut[blockColumns];
+        for (int v = 0; v < blockColumns; ++v) {
+            sum[v] = sumIn[v] = sumOut[v] = vdupq_n_u32(0);
+        }
+
+        for (int i = -radius; i <= radius; ++i) {
+            const uchar *row = src + clampedOffset(lines.begin + i, last, step);
+            const quint32 weight = radius + 1 - std::abs(i);
+            for (int v = 0; v < blockColumns; ++v) {
+                const uint32x4_t p = neonLoad(row + v * 4);
+                sum[v] = vmlaq_n_u32(sum[v], p, weight);
+                if (i > 0) {
+                    sumIn[v] = vaddq_u32(sumIn[v], p);
+                } else {
+                    sumOut[v] = vaddq_u32(sumOut[v], p);
+                }
+            }
+        }
+
+        for (int y = lines.begin; y < lines.end; ++y) {
+            const uchar *out = src + clampedOffset(y - radius, last, step);
+            const uchar *in = src + clampedOffset(y + radius + 1, last, step);
+            const uchar *next = src + clampedOffset(y + 1, last, step);
+            for (int v = 0; v < blockColumns; ++v) {
+                neonStore(dst + v * 4, sum[v], mul, shift, lines.orMask);
+                const uint32x4_t nextPixel = neonLoad(next + v * 4);
+                sum[v] = vsubq_u32(sum[v], sumOut[v]);
+                sumOut[v] = vsubq_u32(sumOut[v], neonLoad(out + v * 4));
+                sumIn[v] = vaddq_u32(sumIn[v], neonLoad(in + v * 4));
+                sum[v] = vaddq_u32(sum[v], sumIn[v]);
+                sumOut[v] = vaddq_u32(sumOut[v], nextPixel);
+                sumIn[v] = vsubq_u32(sumIn[v], nextPixel);
+            }
+            dst += lines.dstPixelStep;
+        }
+    }
+
+    if (column < lines.count) {
+        neonLines(lines.band(column, lines.count - column), radius);
+    }
+}
+#endif
+
+bool StackBlur::isSupported(Simd simd)
+{
+    switch (simd) {
+    case Simd::None:
+        return true;
+    case Simd::SSE2:
+        return cpuHasSse2();
+    case Simd::AVX2: {
+#ifdef STACKBLUR_HAVE_AVX2
+        static const bool avx2 = cpuHasAvx2();
+        return avx2;
+#else
+        return false;
+#endif
+    }
+    case Simd::NEON:
+#ifdef STACKBLUR_HAVE_NEON
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+Simd StackBlur::bestSimd()
+{
+    static const Simd best = [] {
+        for (auto simd : {Simd::AVX2, Simd::SSE2, Simd::NEON}) {
+            if (isSupported(simd)) {
+                return simd;
+            }
+        }
+        return Simd::None;
+    }();
+    return best;
+}
+
+LineKernel StackBlur::lineKernel(Simd simd)
+{
+    if (!isSupported(simd)) {
+        return nullptr;
+    }
+    switch (simd) {
+    case Simd::None:
+        return scalarLines;
+#ifdef STACKBLUR_HAVE_SSE2
+    case Simd::SSE2:
+        return sse2Lines;
+#endif
+#ifdef STACKBLUR_HAVE_AVX2
+    case Simd::AVX2:
+        return avx2Lines;
+#endif
+#ifdef STACKBLUR_HAVE_NEON
+    case Simd::NEON:
+        return neonLines;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+LineKernel StackBlur::columnKernel(Simd simd)
+{
+    if (!isSupported(simd)) {
+        return nullptr;
+    }
+    switch (simd) {
+    case Simd::None:
+        return scalarColumns;
+#ifdef STACKBLUR_HAVE_SSE2
+    case Simd::SSE2:
+        return sse2Columns;
+#endif
+#ifdef STACKBLUR_HAVE_AVX2
+    case Simd::AVX2:
+        return avx2Columns;
+#endif
+#ifdef STACKBLUR_HAVE_NEON
+    case Simd::NEON:
+        return neonColumns;
+#endif
+    default:
+        return nullptr;
+    }
+}
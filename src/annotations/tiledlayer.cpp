@@ -0,0 +1,123 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#include "tiledlayer.h"
+#include "parallel_p.h"
+
+#include <QPainter>
+
+#include <algorithm>
+
+void TiledLayer::reset(const QImage &image)
+{
+    m_image = image;
+    m_tiles.clear();
+    m_columns = (m_image.width() + tileSize - 1) / tileSize;
+    m_rows = (m_image.height() + tileSize - 1) / tileSize;
+    m_tiles.reserve(m_columns * m_rows);
+    const auto bounds = m_image.rect();
+    for (int row = 0; row < m_rows; ++row) {
+        for (int column = 0; column < m_columns; ++column) {
+            m_tiles.append({QRect{column * tileSize, row * tileSize, tileSize, tileSize}.intersected(bounds)});
+        }
+    }
+    m_resetVersion = ++m_version;
+}
+
+QImage TiledLayer::image() const
+{
+    return m_image;
+}
+
+bool TiledLayer::isNull() const
+{
+    return m_image.isNull();
+}
+
+void TiledLayer::markDirty(const QRect &rect)
+{
+    const auto bounded = rect.intersected(m_image.rect());
+    if (bounded.isEmpty()) {
+        return;
+    }
+    for (int row = bounded.top() / tileSize; row <= bounded.bottom() / tileSize; ++row) {
+        for (int column = bounded.left() / tileSize; column <= bounded.right() / tileSize; ++column) {
+            m_tiles[row * m_columns + column].dirty = true;
+        }
+    }
+}
+
+void TiledLayer::markAllDirty()
+{
+    for (auto &tile : m_tiles) {
+        tile.dirty = true;
+    }
+}
+
+bool TiledLayer::isDirty() const
+{
+    return std::ranges::any_of(m_tiles, &Tile::dirty);
+}
+
+void TiledLayer::repaint(const std::function<void(QPainter *painter, const QRect &tileRect)> &paint, int maxThreads)
+{
+    QList<Tile *> dirtyTiles;
+    for (auto &tile : m_tiles) {
+        if (tile.dirty) {
+            dirtyTiles.append(&tile);
+        }
+    }
+    if (dirtyTiles.isEmpty()) {
+        return;
+    }
+    ++m_version;
+    // Only detaches once, before any tile is painted.
+    uchar *bits = m_image.bits();
+    const auto bytesPerLine = m_image.bytesPerLine();
+    const auto bytesPerPixel = m_image.depth() / 8;
+    const auto dpr = m_image.devicePixelRatio();
+    const auto format = m_image.format();
+    // Every tile is its own part of the image with its own painter, so tiles don't share any state.
+    Parallel::forEachBand(int(dirtyTiles.size()), 1, maxThreads, [&](int first, int count) {
+        for (int i = first; i < first + count; ++i) {
+            auto &tile = *dirtyTiles[i];
+            // Shares the pixels of the tile with the layer's image.
+            QImage view(bits + qsizetype(tile.rect.y()) * bytesPerLine + qsizetype(tile.rect.x()) * bytesPerPixel,
+                        tile.rect.width(),
+                        tile.rect.height(),
+                        bytesPerLine,
+                        format);
+            view.setDevicePixelRatio(dpr);
+            QPainter painter(&view);
+            painter.translate(-QPointF(tile.rect.topLeft()) / dpr);
+            paint(&painter, tile.rect);
+            painter.end();
+            tile.dirty = false;
+            tile.version = m_version;
+        }
+    });
+}
+
+const QList<TiledLayer::Tile> &TiledLayer::tiles() const
+{
+    return m_tiles;
+}
+
+quint64 TiledLayer::version() const
+{
+    return m_version;
+}
+
+QRegion TiledLayer::changedSince(quint64 version) const
+{
+    if (version < m_resetVersion) {
+        return m_image.rect();
+    }
+    QRegion region;
+    for (const auto &tile : m_tiles) {
+        if (tile.version > version) {
+            region += tile.rect;
+        }
+    }
+    return region;
+}
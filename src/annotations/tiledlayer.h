@@ -0,0 +1,73 @@
+// SPDX-FileCopyrightText: 2026 KQuickImageEditor authors
+// SPDX-License-Identifier: LGPL-2.0-or-later
+
+#pragma once
+
+#include <QImage>
+#include <QList>
+#include <QRect>
+#include <QRegion>
+
+#include <functional>
+
+class QPainter;
+
+/**
+ * An image that is repainted in tiles.
+ *
+ * Marking a part of the image dirty marks the tiles it touches, and only dirty tiles are repainted.
+ * Each repaint gives the layer a new version and the tiles it repainted get that version, so users
+ * of the image can find the parts that changed since they last read it.
+ *
+ * The tiles are painted directly into the image, so the image never needs to be put together.
+ */
+class TiledLayer
+{
+public:
+    // In image pixels.
+    static constexpr int tileSize = 256;
+
+    struct Tile {
+        // The pixels of the image the tile covers. Tiles at the right and bottom edges can be smaller.
+        QRect rect;
+        bool dirty = true;
+        // The version of the layer when the tile was last repainted.
+        quint64 version = 0;
+    };
+
+    // Replace the image with a transparent image and mark every tile dirty.
+    void reset(const QImage &image);
+
+    // The image with every tile painted so far.
+    QImage image() const;
+    bool isNull() const;
+
+    // Mark the tiles touching `rect` dirty. `rect` is in image pixels.
+    void markDirty(const QRect &rect);
+    void markAllDirty();
+    bool isDirty() const;
+
+    // Repaint the dirty tiles with `paint`.
+    // The painter paints into the tile and is translated so that it uses the device independent
+    // coordinates of the whole image. `tileRect` is the tile in image pixels.
+    // Does nothing and keeps the version if no tile is dirty.
+    // Tiles are painted on up to `maxThreads` threads of QThreadPool::globalInstance(), including
+    // the calling thread, so `paint` must be safe to call from several threads at once.
+    // 0 means as many threads as the pool allows. 1 paints the tiles in order on the calling thread.
+    void repaint(const std::function<void(QPainter *painter, const QRect &tileRect)> &paint, int maxThreads = 0);
+
+    const QList<Tile> &tiles() const;
+    quint64 version() const;
+    // The tiles repainted after the layer had `version`, in image pixels.
+    // The whole image if it was reset after that.
+    QRegion changedSince(quint64 version) const;
+
+private:
+    QImage m_image;
+    // By row, then column.
+    QList<Tile> m_tiles;
+    int m_columns = 0;
+    int m_rows = 0;
+    quint64 m_version = 0;
+    quint64 m_resetVersion = 0;
+};
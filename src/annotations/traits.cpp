@@ -7,6 +7,7 @@
 
 #include <QLocale>
 
+#include "pixelate.h"
 #include "stackblur.h"
 #include "utils.h"
 
@@ -19,7 +20,8 @@ bool Traits::Geometry::isValid() const
 }
 bool Traits::Interactive::isValid() const
 {
-    return !path.isEmpty();
+    // Can always be made.
+    return true;
 }
 bool Traits::Visual::isValid() const
 {
@@ -95,13 +97,6 @@ QString Traits::Text::text() const
 
 // ImageEffects
 
-static const auto strengthKey = u"strength"_s;
-
-static QString strengthString(qreal strength)
-{
-    return QString::number(strength, 'f', std::numeric_limits<qreal>::digits10);
-}
-
 #ifdef Q_OS_WIN
 static qreal clampStrength(qreal strength)
 #else
@@ -133,39 +128,88 @@ void Traits::ImageEffects::Blur::setStrength(qreal strength)
         return;
     }
     m_strength = strength;
-    m_backingStoreCache = {};
 }
 
-QImage Traits::ImageEffects::Blur::image(const std::function<QImage()> &getImage, const QRectF &rect, qreal dpr) const
+static int blurKernelSize(qreal strength, qreal dpr)
+{
+    // Below this, the effect is nearly invisible.
+    static const qreal min = 0.5;
+    // Above this, glitches with color splotches happen.
+    static const qreal max = 60;
+    // Scales with DPR to keep the effect looking similar for different image DPRs.
+    const qreal dynamicMin = 1 * dpr;
+    const qreal dynamicMax = 16 * dpr;
+    const qreal sigma = std::clamp(strength * (dynamicMax - dynamicMin) + dynamicMin, min, max) * 6;
+    return (int)std::round(sigma + 1) | 1;
+}
+
+QRect Traits::ImageEffects::Blur::sourcePixels(const QRectF &rect, qreal dpr) const
+{
+    const int kernelSize = blurKernelSize(m_strength, dpr);
+    const QRect blurRect = Utils::rectScaled(rect, dpr).toAlignedRect();
+    return StackBlur::sourceRect(blurRect, {kernelSize, kernelSize});
+}
+
+QRectF Traits::ImageEffects::Blur::sourceRect(const QRectF &rect, qreal dpr) const
+{
+    return Utils::rectScaled(sourcePixels(rect, dpr), 1 / dpr);
+}
+
+EffectCache::Key Traits::ImageEffects::Blur::key(const QRectF &rect, qreal dpr, const Sources &sources, Quality quality) const
 {
-    if ((m_backingStoreCache.isNull() //
-         || m_backingStoreCache.devicePixelRatio() != dpr //
-         || m_backingStoreCache.text(strengthKey).toDouble() != m_strength)
-        && getImage) {
-        m_backingStoreCache = getImage();
-        if (m_backingStoreCache.isNull()) {
-            return m_backingStoreCache;
+    return {Fill::Blur, sources, Utils::rectScaled(rect, dpr).toAlignedRect(), m_strength, dpr, quality};
+}
+
+QImage Traits::ImageEffects::Blur::apply(const QImage &source, const QRectF &rect, qreal dpr, Quality quality) const
+{
+    if (source.isNull()) {
+        return {};
+    }
+    const int kernelSize = blurKernelSize(m_strength, dpr);
+    // Only blur the rect, which only needs the pixels around it that get blurred into it.
+    const QRect blurRect = Utils::rectScaled(rect, dpr).toAlignedRect();
+    const QRect sourceRect = StackBlur::sourceRect(blurRect, {kernelSize, kernelSize}).intersected({source.offset(), source.size()});
+    const QRect roi = blurRect.translated(-sourceRect.topLeft());
+    // How much smaller the image is blurred in interactive quality.
+    // The blur removes most of the detail lost by scaling down anyway.
+    static constexpr int interactiveScale = 4;
+    if (quality == Quality::Interactive && kernelSize >= interactiveScale * 2 && !sourceRect.isEmpty()) {
+        const QSize smallSize = (sourceRect.size() / interactiveScale).expandedTo({1, 1});
+        QImage small = source.copy(sourceRect.translated(-source.offset())).scaled(smallSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        const int smallKernelSize = (kernelSize / interactiveScale) | 1;
+        StackBlur::parallelBlur(small, {smallKernelSize, smallKernelSize});
+        QImage result = small.scaled(sourceRect.size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation).copy(roi);
+        result.setOffset({});
+        result.setDevicePixelRatio(dpr);
+        return result;
+    }
+    // Blurred in the format of the image, so 16-bit and floating point images keep their precision.
+    QImage result = source.copy(sourceRect.translated(-source.offset()));
+    StackBlur::parallelBlur(result, roi, {kernelSize, kernelSize});
+    result = result.copy(roi);
+    result.setOffset({});
+    result.setDevicePixelRatio(dpr);
+    return result;
+}
+
+QImage Traits::ImageEffects::Blur::image(const std::function<QImage()> &getImage,
+                                      const QRectF &rect,
+                                      qreal dpr,
+                                      const Sources &sources,
+                                      EffectCache *cache,
+                                      Quality quality) const
+{
+    const auto key = this->key(rect, dpr, sources, quality);
+    if (cache) {
+        if (auto cached = cache->find(key); !cached.isNull()) {
+            return cached;
         }
-        // RGBA is better for use with stackblur
-        m_backingStoreCache.convertTo(QImage::Format_RGBA8888_Premultiplied);
-        // Below this, the effect is nearly invisible.
-        static const qreal min = 0.5;
-        // Above this, glitches with color splotches happen.
-        static const qreal max = 60;
-        // Scales with DPR to keep the effect looking similar for different image DPRs.
-        const qreal dynamicMin = 1 * dpr;
-        const qreal dynamicMax = 16 * dpr;
-        const qreal sigma = std::clamp(m_strength * (dynamicMax - dynamicMin) + dynamicMin, min, max) * 6;
-        const int kernelSize = (int)std::round(sigma + 1) | 1;
-        StackBlur::blur(m_backingStoreCache, {kernelSize, kernelSize});
-        m_backingStoreCache.setDevicePixelRatio(dpr);
-        m_backingStoreCache.setText(strengthKey, strengthString(m_strength));
-    }
-    QRect copyRect = Utils::rectScaled(rect, m_backingStoreCache.devicePixelRatio()).toAlignedRect();
-    if (copyRect.size() != m_backingStoreCache.size()) {
-        return m_backingStoreCache.copy(copyRect);
-    }
-    return m_backingStoreCache;
+    }
+    const auto result = apply(getImage ? getImage() : QImage{}, rect, dpr, quality);
+    if (cache && !result.isNull()) {
+        cache->insert(key, result);
+    }
+    return result;
 }
 
 Traits::ImageEffects::Pixelate::Pixelate(qreal strength)
@@ -185,38 +229,87 @@ void Traits::ImageEffects::Pixelate::setStrength(qreal strength)
         return;
     }
     m_strength = strength;
-    m_backingStoreCache = {};
 }
 
-QImage Traits::ImageEffects::Pixelate::image(const std::function<QImage()> &getImage, const QRectF &rect, qreal dpr) const
+static int pixelateFactor(qreal strength, qreal dpr)
+{
+    // 1x would have no effect and a fractional scale would look bad, so 2x is the minimum.
+    static const qreal min = 2;
+    // Scales with DPR to keep the effect looking similar for different image DPRs.
+    const qreal dynamicMin = min * dpr;
+    const qreal dynamicMax = 16 * dpr;
+    return int(std::max(std::round(strength * (dynamicMax - dynamicMin) + dynamicMin), min));
+}
+
+QRect Traits::ImageEffects::Pixelate::sourcePixels(const QRectF &rect, qreal dpr) const
+{
+    const QRect pixelateRect = Utils::rectScaled(rect, dpr).toAlignedRect();
+    return Pixelation::blockAlignedRect(pixelateRect, pixelateFactor(m_strength, dpr));
+}
+
+QRectF Traits::ImageEffects::Pixelate::sourceRect(const QRectF &rect, qreal dpr) const
+{
+    return Utils::rectScaled(sourcePixels(rect, dpr), 1 / dpr);
+}
+
+EffectCache::Key Traits::ImageEffects::Pixelate::key(const QRectF &rect, qreal dpr, const Sources &sources, Quality quality) const
+{
+    return {Fill::Pixelate, sources, Utils::rectScaled(rect, dpr).toAlignedRect(), m_strength, dpr, quality};
+}
+
+QImage Traits::ImageEffects::Pixelate::apply(const QImage &source, const QRectF &rect, qreal dpr, Quality quality) const
+{
+    if (source.isNull()) {
+        return {};
+    }
+    // Only pixelate the rect. The blocks are on a grid aligned to the whole image,
+    // so the blocks of overlapping or neighbouring rects match. A part of the image
+    // starts at a block boundary, so its blocks are on the same grid.
+    const QRect pixelateRect = Utils::rectScaled(rect, dpr).toAlignedRect().translated(-source.offset());
+    const int factor = pixelateFactor(m_strength, dpr);
+    if (quality == Quality::Interactive) {
+        // Each block gets the color of one of its pixels instead of the average of all of them.
+        const QRect sourceRect = Pixelation::blockAlignedRect(pixelateRect, factor).intersected(source.rect());
+        if (sourceRect.isEmpty()) {
+            return {};
+        }
+        const QSize blocks{(sourceRect.width() + factor - 1) / factor, (sourceRect.height() + factor - 1) / factor};
+        const QImage sampled = source.copy(sourceRect).scaled(blocks, Qt::IgnoreAspectRatio, Qt::FastTransformation);
+        // The parts of the rect outside of the image stay transparent.
+        QImage result = sampled.scaled(blocks * factor, Qt::IgnoreAspectRatio, Qt::FastTransformation).copy(pixelateRect.translated(-sourceRect.topLeft()));
+        result.setOffset({});
+        result.setDevicePixelRatio(dpr);
+        return result;
+    }
+    const QRect insideRect = pixelateRect.intersected(source.rect());
+    QImage result = Pixelation::pixelated(source, pixelateRect, factor);
+    if (insideRect != pixelateRect) {
+        // The parts of the rect outside of the image stay transparent.
+        result = result.copy(pixelateRect.translated(-insideRect.topLeft()));
+    }
+    result.setOffset({});
+    result.setDevicePixelRatio(dpr);
+    return result;
+}
+
+QImage Traits::ImageEffects::Pixelate::image(const std::function<QImage()> &getImage,
+                                      const QRectF &rect,
+                                      qreal dpr,
+                                      const Sources &sources,
+                                      EffectCache *cache,
+                                      Quality quality) const
 {
-    if ((m_backingStoreCache.isNull() //
-         || m_backingStoreCache.devicePixelRatio() != dpr //
-         || m_backingStoreCache.text(strengthKey).toDouble() != m_strength)
-        && getImage) {
-        m_backingStoreCache = getImage();
-        if (m_backingStoreCache.isNull()) {
-            return m_backingStoreCache;
+    const auto key = this->key(rect, dpr, sources, quality);
+    if (cache) {
+        if (auto cached = cache->find(key); !cached.isNull()) {
+            return cached;
         }
-        // 1x would have no effect and a fractional scale would look bad, so 2x is the minimum.
-        static const qreal min = 2;
-        // Scales with DPR to keep the effect looking similar for different image DPRs.
-        const qreal dynamicMin = min * dpr;
-        const qreal dynamicMax = 16 * dpr;
-        const auto factor = std::max(std::round(m_strength * (dynamicMax - dynamicMin) + dynamicMin), min);
-        auto scaleDown = QTransform::fromScale(1 / factor, 1 / factor);
-        auto scaleUp = QTransform::fromScale(factor, factor);
-        // Smooth when scaling down to average out the colors.
-        m_backingStoreCache = m_backingStoreCache.transformed(scaleDown, Qt::SmoothTransformation);
-        m_backingStoreCache = m_backingStoreCache.transformed(scaleUp, Qt::FastTransformation);
-        m_backingStoreCache.setDevicePixelRatio(dpr);
-        m_backingStoreCache.setText(strengthKey, strengthString(m_strength));
-    }
-    QRect copyRect = Utils::rectScaled(rect, m_backingStoreCache.devicePixelRatio()).toAlignedRect();
-    if (copyRect.size() != m_backingStoreCache.size()) {
-        return m_backingStoreCache.copy(copyRect);
-    }
-    return m_backingStoreCache;
+    }
+    const auto result = apply(getImage ? getImage() : QImage{}, rect, dpr, quality);
+    if (cache && !result.isNull()) {
+        cache->insert(key, result);
+    }
+    return result;
 }
 
 // Functions
@@ -317,6 +410,34 @@ QPainterPath Traits::createStrokePath(const OptTuple &traits, const QPen *otherP
     }
 }
 
+void Traits::extendStroke(OptTuple &traits, const QPainterPath &segment)
+{
+    auto &stroke = std::get<Stroke::Opt>(traits);
+    if (!stroke || stroke->path.isEmpty()) {
+        // Nothing to extend.
+        clearForInit(traits);
+        initOptTuple(traits);
+        return;
+    }
+    QPainterPathStroker stroker(stroke->pen);
+    const auto outline = stroker.createStroke(segment);
+    // Overlapping subpaths are filled once with the winding fill rule,
+    // so the joins look like the ones of a single stroke.
+    stroke->path.setFillRule(Qt::WindingFill);
+    stroke->path.addPath(outline);
+    if (auto &visual = std::get<Visual::Opt>(traits)) {
+        auto rect = outline.boundingRect() | segment.boundingRect();
+        auto &shadow = std::get<Shadow::Opt>(traits);
+        if (shadow && shadow->enabled && !rect.isEmpty()) {
+            rect += Shadow::margins;
+        }
+        visual->rect |= rect;
+    }
+    if (auto &interactive = std::get<Interactive::Opt>(traits)) {
+        *interactive = {};
+    }
+}
+
 QPainterPath Traits::createInteractivePath(const OptTuple &traits)
 {
     auto &geometry = std::get<Geometry::Opt>(traits);
@@ -339,6 +460,36 @@ QPainterPath Traits::createInteractivePath(const OptTuple &traits)
     return mousePath.simplified();
 }
 
+// How far from the lines of the hit shape is still a hit.
+static qreal hitHalfWidth(const Traits::OptTuple &traits)
+{
+    auto &stroke = std::get<Traits::Stroke::Opt>(traits);
+    // The extra 1px all around of the mousePath.
+    return stroke && stroke->isValid() ? stroke->pen.widthF() / 2 + 0.5 : 0.5;
+}
+
+HitShape Traits::createHitShape(const OptTuple &traits)
+{
+    auto &geometry = std::get<Geometry::Opt>(traits);
+    auto &stroke = std::get<Stroke::Opt>(traits);
+    QPainterPath path;
+    if (geometry && geometry->isValid()) {
+        path = geometry->path;
+    }
+    // If it's somehow still empty, force it to be clickable.
+    path = Traits::minPath(path);
+    HitShape shape;
+    // Clicking anywhere within the bounds works, like with the winding fill of the mousePath.
+    shape.addPath(path, true);
+    if (stroke && stroke->isValid() && std::get<Arrow::Opt>(traits)) {
+        const int size = path.elementCount();
+        const QLineF lastLine{path.elementAt(size - 2), path.elementAt(size - 1)};
+        shape.addPath(Traits::arrowHead(lastLine, stroke->pen.widthF()), false);
+    }
+    shape.setHalfWidth(hitHalfWidth(traits));
+    return shape;
+}
+
 QRectF Traits::createVisualRect(const OptTuple &traits)
 {
     auto &geometry = std::get<Geometry::Opt>(traits);
@@ -360,7 +511,7 @@ QRectF Traits::createVisualRect(const OptTuple &traits)
     return visualRect;
 }
 
-void Traits::fastInitOptTuple(OptTuple &traits)
+void Traits::initOptTuple(OptTuple &traits)
 {
     auto &geometry = std::get<Geometry::Opt>(traits);
     if (geometry) {
@@ -382,16 +533,6 @@ void Traits::fastInitOptTuple(OptTuple &traits)
     }
 }
 
-void Traits::initOptTuple(OptTuple &traits)
-{
-    fastInitOptTuple(traits);
-    auto &interactive = std::get<Interactive::Opt>(traits);
-    if (interactive && interactive->path.isEmpty()) {
-        // Set Interactive::path from Stroke and Geometry if empty.
-        interactive->path = createInteractivePath(traits);
-    }
-}
-
 template<typename T>
 void clearForInitHelper(Traits::OptTuple &traits)
 {
@@ -401,7 +542,7 @@ void clearForInitHelper(Traits::OptTuple &traits)
     }
     auto &trait = traitOpt.value();
     if constexpr (std::same_as<T, Traits::Interactive>) {
-        trait.path.clear();
+        trait = {};
     } else if constexpr (std::same_as<T, Traits::Visual>) {
         trait.rect = {};
     } else if constexpr (std::same_as<T, Traits::Stroke>) {
@@ -441,6 +582,18 @@ void Traits::clearForInit(OptTuple &traits)
     clearForInitHelper<Text>(traits);
 }
 
+void Traits::clearStrokeForInit(OptTuple &traits)
+{
+    clearForInitHelper<Interactive>(traits);
+    clearForInitHelper<Visual>(traits);
+    clearForInitHelper<Stroke>(traits);
+}
+
+void Traits::clearShadowForInit(OptTuple &traits)
+{
+    clearForInitHelper<Visual>(traits);
+}
+
 void Traits::reInitTraits(OptTuple &traits)
 {
     clearForInit(traits);
@@ -461,10 +614,16 @@ void Traits::transformTraits(const QTransform &transform, OptTuple &traits)
         geometry->path = transform.map(geometry->path);
     }
     auto &interactive = std::get<Interactive::Opt>(traits);
-    if (interactive && onlyTranslating) {
-        interactive->path.translate(transform.dx(), transform.dy());
-    } else if (interactive) {
-        interactive->path = transform.map(interactive->path);
+    // Only what was already made, the rest is made from the transformed traits when needed.
+    if (interactive && interactive->shape && onlyTranslating) {
+        interactive->shape->translate(transform.dx(), transform.dy());
+    } else if (interactive && interactive->shape) {
+        interactive->shape->transform(transform);
+    }
+    if (interactive && interactive->path && onlyTranslating) {
+        interactive->path->translate(transform.dx(), transform.dy());
+    } else if (interactive && interactive->path) {
+        interactive->path = transform.map(*interactive->path);
     }
     auto &visual = std::get<Visual::Opt>(traits);
     if (visual && onlyTranslating) {
@@ -594,7 +753,45 @@ QRectF Traits::geometryPathBounds(const OptTuple &traits)
 QPainterPath Traits::interactivePath(const OptTuple &traits)
 {
     auto &interactive = std::get<Interactive::Opt>(traits);
-    return interactive ? interactive->path : QPainterPath{};
+    if (!interactive) {
+        return {};
+    }
+    if (!interactive->path) {
+        interactive->path = createInteractivePath(traits);
+    }
+    return *interactive->path;
+}
+
+const HitShape &Traits::hitShape(const OptTuple &traits)
+{
+    static const HitShape emptyShape;
+    auto &interactive = std::get<Interactive::Opt>(traits);
+    if (!interactive) {
+        return emptyShape;
+    }
+    if (!interactive->shape) {
+        interactive->shape = createHitShape(traits);
+    }
+    return *interactive->shape;
+}
+
+QRectF Traits::hitBounds(const OptTuple &traits)
+{
+    auto &interactive = std::get<Interactive::Opt>(traits);
+    if (!interactive) {
+        return {};
+    }
+    if (interactive->shape) {
+        return interactive->shape->boundingRect();
+    }
+    // A bit bigger than the shape, but without going through any paths.
+    // Visual::rect has the geometry and the arrow head in it.
+    const auto rect = visualRect(traits);
+    if (rect.isNull()) {
+        return hitShape(traits).boundingRect();
+    }
+    const auto halfWidth = hitHalfWidth(traits);
+    return rect.adjusted(-halfWidth, -halfWidth, halfWidth, halfWidth);
 }
 
 QRectF Traits::visualRect(const OptTuple &traits)
@@ -626,7 +823,8 @@ QDebug operator<<(QDebug debug, const Traits::Interactive &trait)
     debug.nospace();
     debug << "Interactive" << '(';
     debug << (const void *)&trait;
-    debug << ",\n    path=" << trait.path;
+    debug << ",\n    shape.boundingRect=" << (trait.shape ? trait.shape->boundingRect() : QRectF{});
+    debug << ",\n    path=" << trait.path.value_or(QPainterPath{});
     debug << ')';
     return debug;
 }
@@ -13,6 +13,9 @@
 #include <QPen>
 #include <QUuid>
 
+#include "effectcache.h"
+#include "hitshape.h"
+
 #include <optional>
 #include <tuple>
 
@@ -89,22 +92,36 @@ QPainterPath createTextPath(const OptTuple &traits);
 // Get the stroke path based on the available traits.
 QPainterPath createStrokePath(const OptTuple &traits, const QPen *otherPen = nullptr);
 
+// Add the stroke of `segment`, which was just added to the end of Geometry::path, to Stroke::path
+// and Visual::rect without stroking the whole path again. Interactive is cleared.
+// The outline has a separate subpath for every segment, so it should be made again once the
+// path is done.
+void extendStroke(OptTuple &traits, const QPainterPath &segment);
+
 // Constructs a mousePath based on the available traits.
+// Expensive, so it is only made when it is needed for showing, see interactivePath().
 QPainterPath createInteractivePath(const OptTuple &traits);
 
+// Constructs the shape used for hit testing, covering the same area as the mousePath.
+HitShape createHitShape(const OptTuple &traits);
+
 // Constructs a visualRect based on the available traits.
 QRectF createVisualRect(const OptTuple &traits);
 
-// Excludes computationally expensive parts that aren't needed for rendering
-void fastInitOptTuple(OptTuple &traits);
-
 // Initialize an OptTuple the way a HistoryItem should have it.
-// Returns true if changes were done.
+// Only makes what rendering needs. Interactive is made when it is first used.
 void initOptTuple(OptTuple &traits);
 
 // Clear the given traits in the OptTuple for reinitialization.
 void clearForInit(OptTuple &traits);
 
+// Clear only the traits made from Stroke::pen for reinitialization:
+// Stroke::path, Visual::rect and Interactive.
+void clearStrokeForInit(OptTuple &traits);
+
+// Clear only the traits made from Shadow for reinitialization: Visual::rect.
+void clearShadowForInit(OptTuple &traits);
+
 // clearForInit and initOptTuple
 void reInitTraits(OptTuple &traits);
 
@@ -133,9 +150,18 @@ QPainterPath geometryPath(const OptTuple &traits);
 // Returns the Geometry::path::boundingRect or an empty rect if not available.
 QRectF geometryPathBounds(const OptTuple &traits);
 
-// Returns the Interactive::path or an empty path if not available.
+// Returns the Interactive::path, made with createInteractivePath() if it wasn't made yet,
+// or an empty path if not available.
 QPainterPath interactivePath(const OptTuple &traits);
 
+// Returns the Interactive::shape, made with createHitShape() if it wasn't made yet,
+// or an empty shape if not available.
+const HitShape &hitShape(const OptTuple &traits);
+
+// Returns bounds containing the Interactive::shape, without making it if it wasn't made yet,
+// or an empty rect if not available.
+QRectF hitBounds(const OptTuple &traits);
+
 // Returns the Visual::rect or an empty rect if not available.
 QRectF visualRect(const OptTuple &traits);
 
@@ -182,9 +208,18 @@ struct Geometry {
 };
 
 struct Interactive {
-    COMMON_TRAIT_DEFS(Interactive)
-    // The the path bounds used for mouse interaction.
-    QPainterPath path{};
+    using Opt = std::optional<Interactive>;
+    // Only holds what is made from other traits, so there is nothing to compare.
+    bool operator==(const Interactive &) const
+    {
+        return true;
+    }
+    bool isValid() const;
+    // The area used for mouse interaction. Made by hitShape() when first used.
+    // Made by whichever thread first uses it, so it must not be used from several threads at once.
+    mutable std::optional<HitShape> shape{};
+    // The same area as a path, for showing it. Made by interactivePath() when first used.
+    mutable std::optional<QPainterPath> path{};
 };
 
 struct Visual {
@@ -216,18 +251,36 @@ public:
     qreal strength() const;
     void setStrength(qreal);
 
+    // The section of the document that the effect for `rect` is made from.
+    QRectF sourceRect(const QRectF &rect, qreal dpr) const;
+    // The same in pixels of the original image.
+    QRect sourcePixels(const QRectF &rect, qreal dpr) const;
+
+    // What the image for `rect` is stored as in an EffectCache.
+    EffectCache::Key key(const QRectF &rect, qreal dpr, const Sources &sources, Quality quality = Quality::Full) const;
+
+    // Make the image of the effect for `rect` from `source`.
+    // `source` is the original image or a part of it that contains sourcePixels() inside the
+    // original image, positioned at its offset(). Safe to call from any thread.
+    QImage apply(const QImage &source, const QRectF &rect, qreal dpr, Quality quality = Quality::Full) const;
+
     // Get an image that can be immediately used for rendering an image effect.
     // `getImage` should be the function used to generate the original image with no effects.
     // `rect` should be the section of the document you want to render over .
     // `dpr` should be the devicePixelRatio of the original image.
-    QImage image(const std::function<QImage()> &getImage, const QRectF &rect, qreal dpr) const;
+    // `sources` should be what the original image is made from inside sourceRect().
+    // The image is only made again when `cache` has no image for the same sources, rect,
+    // strength, DPR and quality. Without a cache, it is made every time.
+    QImage image(const std::function<QImage()> &getImage,
+                 const QRectF &rect,
+                 qreal dpr,
+                 const Sources &sources,
+                 EffectCache *cache,
+                 Quality quality = Quality::Full) const;
 
     bool operator==(const Blur &other) const = default;
 
 private:
-    // Setting as mutable means it can be mutated even when this is const
-    // or using a const member function.
-    mutable QImage m_backingStoreCache{};
     qreal m_strength = 0;
 };
 
@@ -240,16 +293,36 @@ public:
     qreal strength() const;
     void setStrength(qreal);
 
+    // The section of the document that the effect for `rect` is made from.
+    QRectF sourceRect(const QRectF &rect, qreal dpr) const;
+    // The same in pixels of the original image.
+    QRect sourcePixels(const QRectF &rect, qreal dpr) const;
+
+    // What the image for `rect` is stored as in an EffectCache.
+    EffectCache::Key key(const QRectF &rect, qreal dpr, const Sources &sources, Quality quality = Quality::Full) const;
+
+    // Make the image of the effect for `rect` from `source`.
+    // `source` is the original image or a part of it that contains sourcePixels() inside the
+    // original image, positioned at its offset(). Safe to call from any thread.
+    QImage apply(const QImage &source, const QRectF &rect, qreal dpr, Quality quality = Quality::Full) const;
+
     // Get an image that can be immediately used for rendering an image effect.
     // `getImage` should be the function used to generate the original image with no effects.
     // `rect` should be the section of the document you want to render over .
     // `dpr` should be the devicePixelRatio of the original image.
-    QImage image(const std::function<QImage()> &getImage, const QRectF &rect, qreal dpr) const;
+    // `sources` should be what the original image is made from inside sourceRect().
+    // The image is only made again when `cache` has no image for the same sources, rect,
+    // strength, DPR and quality. Without a cache, it is made every time.
+    QImage image(const std::function<QImage()> &getImage,
+                 const QRectF &rect,
+                 qreal dpr,
+                 const Sources &sources,
+                 EffectCache *cache,
+                 Quality quality = Quality::Full) const;
 
     bool operator==(const Pixelate &other) const = default;
 
 private:
-    mutable QImage m_backingStoreCache{};
     qreal m_strength = 0;
 };
 }